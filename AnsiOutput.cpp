@@ -0,0 +1,167 @@
+#include "AnsiOutput.h"
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+
+using namespace std;
+
+// ask the terminal to hold the frame until it is complete
+static const char BeginSynchronizedUpdate[] = "\x1b[?2026h";
+static const char EndSynchronizedUpdate[] = "\x1b[?2026l";
+
+void AnsiOutput::definePair(short pair, short foreground, short background)
+{
+    if (pair <= 0 || pair >= MaxColorPairs)
+        return;
+    char sequence[32];
+    snprintf(sequence, sizeof(sequence), "\x1b[0;%d;%dm", 30 + foreground, 40 + background);
+    m_pairSequence[pair] = sequence;
+}
+
+void AnsiOutput::invalidate()
+{
+    m_cursorX = m_cursorY = -1;
+    m_color = -1;
+}
+
+void AnsiOutput::beginFrame()
+{
+    m_buffer.clear();
+    m_buffer += BeginSynchronizedUpdate;
+}
+
+void AnsiOutput::moveTo(int x, int y)
+{
+    if (x == m_cursorX && y == m_cursorY)
+        return;
+    char sequence[32];
+    if (y == m_cursorY && x > m_cursorX && m_cursorX >= 0)
+    {
+        int distance = x - m_cursorX;
+        if (distance == 1)
+            snprintf(sequence, sizeof(sequence), "\x1b[C");
+        else
+            snprintf(sequence, sizeof(sequence), "\x1b[%dC", distance);
+    }
+    else if (x == 0)
+    {
+        snprintf(sequence, sizeof(sequence), "\x1b[%dH", y + 1);
+    }
+    else
+    {
+        snprintf(sequence, sizeof(sequence), "\x1b[%d;%dH", y + 1, x + 1);
+    }
+    m_buffer += sequence;
+    m_cursorX = x;
+    m_cursorY = y;
+}
+
+void AnsiOutput::setColor(short pair)
+{
+    if (pair == m_color)
+        return;
+    if (pair > 0 && pair < MaxColorPairs && !m_pairSequence[pair].empty())
+        m_buffer += m_pairSequence[pair];
+    else
+        m_buffer += "\x1b[0m";
+    m_color = pair;
+}
+
+void AnsiOutput::put(wchar_t ch)
+{
+    // UTF-8
+    unsigned code = ch;
+    if (code < 0x80)
+    {
+        m_buffer += (char)code;
+    }
+    else if (code < 0x800)
+    {
+        m_buffer += (char)(0xc0 | (code >> 6));
+        m_buffer += (char)(0x80 | (code & 0x3f));
+    }
+    else if (code < 0x10000)
+    {
+        m_buffer += (char)(0xe0 | (code >> 12));
+        m_buffer += (char)(0x80 | ((code >> 6) & 0x3f));
+        m_buffer += (char)(0x80 | (code & 0x3f));
+    }
+    else
+    {
+        m_buffer += (char)(0xf0 | (code >> 18));
+        m_buffer += (char)(0x80 | ((code >> 12) & 0x3f));
+        m_buffer += (char)(0x80 | ((code >> 6) & 0x3f));
+        m_buffer += (char)(0x80 | (code & 0x3f));
+    }
+    // after the last column the cursor waits to wrap, don't rely on it
+    if (++m_cursorX >= m_columns && m_columns > 0)
+        m_cursorX = m_cursorY = -1;
+}
+
+void AnsiOutput::drawCells(const FrameBuffer &frame, int y, int begin, int end, int left, int top)
+{
+    const Cell *row = frame.row(y);
+    moveTo(left + begin, top + y);
+    for (int x = begin; x < end; x++)
+    {
+        setColor(row[x].colorPair);
+        put(row[x].ch);
+    }
+}
+
+void AnsiOutput::drawText(int x, int y, const char *text)
+{
+    moveTo(x, y);
+    setColor(0);
+    for (; *text; text++)
+        put((unsigned char)*text);
+}
+
+void AnsiOutput::drawBox(int left, int top, int width, int height)
+{
+    setColor(0);
+    int right = left + width - 1;
+    int bottom = top + height - 1;
+    moveTo(left, top);
+    put(L'┌');
+    for (int x = left + 1; x < right; x++)
+        put(L'─');
+    put(L'┐');
+    for (int y = top + 1; y < bottom; y++)
+    {
+        moveTo(left, y);
+        put(L'│');
+        moveTo(right, y);
+        put(L'│');
+    }
+    moveTo(left, bottom);
+    put(L'└');
+    for (int x = left + 1; x < right; x++)
+        put(L'─');
+    put(L'┘');
+}
+
+void AnsiOutput::endFrame()
+{
+    m_buffer += EndSynchronizedUpdate;
+    m_stats.bytes = 0;
+    m_stats.syscalls = 0;
+    const char *data = m_buffer.data();
+    size_t left = m_buffer.size();
+    while (left > 0)
+    {
+        ssize_t written = write(m_fd, data, left);
+        m_stats.syscalls++;
+        if (written < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            // the terminal is gone, nothing sensible left to do
+            invalidate();
+            break;
+        }
+        data += written;
+        left -= written;
+        m_stats.bytes += written;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+
+#include "OutputBackend.h"
+
+// Writes ANSI/VT escape sequences straight to a file descriptor, without
+// ncurses. A frame is built in one buffer and sent with a single write(),
+// wrapped in synchronized update sequences so the terminal shows it all at
+// once. Cursor moves are skipped when the next cell is where the cursor
+// already is, or shortened to a relative move along the row, and colours
+// are only changed where a run of cells changes colour.
+//
+// The backend tracks what it last sent, so anything else drawing on the
+// terminal must be followed by invalidate().
+class AnsiOutput : public OutputBackend
+{
+public:
+    static const int MaxColorPairs = 16;
+
+    // fd 1 (stdout) unless told otherwise
+    void setFd(int fd) { m_fd = fd; }
+    // screen size in characters, the cursor position is unknown after
+    // writing the last column
+    void resize(int columns, int rows) { m_columns = columns; m_rows = rows; }
+    // colours of a colour pair, 0-7 as in COLOR_BLACK..COLOR_WHITE. Pair 0
+    // is the terminal default.
+    void definePair(short pair, short foreground, short background);
+
+    const char *name() const override { return "ANSI"; }
+    void beginFrame() override;
+    void drawCells(const FrameBuffer &frame, int y, int begin, int end, int left, int top) override;
+    void drawText(int x, int y, const char *text) override;
+    void drawBox(int left, int top, int width, int height) override;
+    void endFrame() override;
+    void invalidate() override;
+
+    // the bytes of the last frame
+    const std::string &buffer() const { return m_buffer; }
+
+private:
+    void moveTo(int x, int y);
+    void setColor(short pair);
+    void put(wchar_t ch);
+
+private:
+    int m_fd = 1;
+    int m_columns = 0;
+    int m_rows = 0;
+    std::string m_buffer;
+    std::string m_pairSequence[MaxColorPairs];
+    int m_cursorX = -1;         // -1 when unknown
+    int m_cursorY = -1;
+    short m_color = -1;
+};
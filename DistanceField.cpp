@@ -0,0 +1,124 @@
+#include "DistanceField.h"
+#include <algorithm>
+
+using namespace std;
+
+void DistanceField::build(const WallMap &map)
+{
+    m_width = map.width();
+    m_height = map.height();
+    m_distances.assign((size_t)m_width * m_height, 0);
+    sweep(map, 0, 0, m_width, m_height);
+}
+
+void DistanceField::sweep(const WallMap &map, int left, int top, int right, int bottom)
+{
+    // outside the map counts as wall, so cells outside the field read as 0
+    auto value = [&](int x, int y) { return x < 0 || y < 0 || x >= m_width || y >= m_height ? 0 : at(x, y); };
+
+    for (int y = top; y < bottom; y++)
+        for (int x = left; x < right; x++)
+        {
+            if (map.isWall(x, y))
+            {
+                cell(x, y) = 0;
+                continue;
+            }
+            // the cells before this one in scan order are done, so are the
+            // ones outside the rectangle
+            int distance = MaxDistance;
+            distance = min(distance, value(x - 1, y) + 1);
+            distance = min(distance, value(x - 1, y - 1) + 1);
+            distance = min(distance, value(x, y - 1) + 1);
+            distance = min(distance, value(x + 1, y - 1) + 1);
+            if (y + 1 == bottom || x + 1 == right)
+            {
+                // the cells after it only count when they are not redone
+                if (x + 1 == right)
+                {
+                    distance = min(distance, value(x + 1, y) + 1);
+                    distance = min(distance, value(x + 1, y + 1) + 1);
+                }
+                if (y + 1 == bottom)
+                {
+                    distance = min(distance, value(x - 1, y + 1) + 1);
+                    distance = min(distance, value(x, y + 1) + 1);
+                    distance = min(distance, value(x + 1, y + 1) + 1);
+                }
+            }
+            cell(x, y) = distance;
+        }
+
+    for (int y = bottom - 1; y >= top; y--)
+        for (int x = right - 1; x >= left; x--)
+        {
+            int distance = at(x, y);
+            if (distance == 0)
+                continue;
+            distance = min(distance, value(x + 1, y) + 1);
+            distance = min(distance, value(x + 1, y + 1) + 1);
+            distance = min(distance, value(x, y + 1) + 1);
+            distance = min(distance, value(x - 1, y + 1) + 1);
+            cell(x, y) = distance;
+        }
+}
+
+void DistanceField::cellChanged(const WallMap &map, int x, int y)
+{
+    if (!matches(map) || !map.inBounds(x, y))
+        return;
+
+    // visit the cells on the ring at Chebyshev distance r around x, y
+    auto ring = [&](int r, auto visit)
+    {
+        for (int i = -r; i <= r; i++)
+        {
+            int cells[4][2] = { { x + i, y - r }, { x + i, y + r }, { x - r, y + i }, { x + r, y + i } };
+            // the corners are on two sides, visit them once
+            int sides = i == -r || i == r ? 2 : 4;
+            for (int side = 0; side < sides; side++)
+            {
+                int cx = cells[side][0], cy = cells[side][1];
+                if (cx >= 0 && cy >= 0 && cx < m_width && cy < m_height)
+                    visit(cx, cy);
+            }
+        }
+    };
+
+    if (map.isWall(x, y))
+    {
+        // distances only drop, and once a ring has nothing to lower neither
+        // has any ring further out
+        cell(x, y) = 0;
+        for (int r = 1; r < MaxDistance; r++)
+        {
+            bool lowered = false;
+            ring(r, [&](int cx, int cy)
+            {
+                if (at(cx, cy) > r)
+                {
+                    cell(cx, cy) = r;
+                    lowered = true;
+                }
+            });
+            if (!lowered)
+                break;
+        }
+        return;
+    }
+
+    // A cell at distance r from the removed wall may have had it as its
+    // nearest wall. If no cell of a ring did, no cell further out did, so
+    // only the square up to the last such ring has to be recomputed.
+    int radius = 0;
+    for (int r = 1; r <= MaxDistance; r++)
+    {
+        bool dependent = false;
+        ring(r, [&](int cx, int cy) { dependent |= at(cx, cy) == r; });
+        if (!dependent)
+            break;
+        radius = r;
+    }
+    sweep(map, max(0, x - radius), max(0, y - radius),
+          min(m_width, x + radius + 1), min(m_height, y + radius + 1));
+}
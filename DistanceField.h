@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "WallMap.h"
+
+// Chebyshev distance from every cell of a WallMap to the nearest wall,
+// counting the cells around the map as walls too. A cell at distance d
+// has only floor within d - 1 cells in every direction, which lets a ray
+// leap across that whole square in one step instead of visiting every
+// cell in it. Distances are capped at MaxDistance, one byte per cell.
+//
+// Edits only recompute the cells near them: adding a wall lowers the
+// distances in rings around it until a ring has nothing to lower, and
+// removing one recomputes the square of cells that were nearest to it.
+class DistanceField
+{
+public:
+    static const int MaxDistance = 255;
+
+    // compute the whole field for map
+    void build(const WallMap &map);
+    // cell x, y of map changed, map already holds the new value
+    void cellChanged(const WallMap &map, int x, int y);
+
+    bool matches(const WallMap &map) const { return m_width == map.width() && m_height == map.height(); }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int at(int x, int y) const { return m_distances[(size_t)y * m_width + x]; }
+    size_t memoryBytes() const { return m_distances.size(); }
+
+private:
+    uint8_t &cell(int x, int y) { return m_distances[(size_t)y * m_width + x]; }
+    // Recompute the cells in [left, right) x [top, bottom) from the map and
+    // the cells around the rectangle, with a forward and a backward pass
+    void sweep(const WallMap &map, int left, int top, int right, int bottom);
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<uint8_t> m_distances;
+};
@@ -0,0 +1,273 @@
+#include "EntityLayer.h"
+#include "Random.h"
+#include "Renderer.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+using namespace std;
+
+const char *EntityLayer::kindName(Kind kind)
+{
+    switch (kind)
+    {
+    case Pickup:    return "pickup";
+    case Npc:       return "npc";
+    case Marker:    return "marker";
+    default:        return "?";
+    }
+}
+
+void EntityLayer::clear()
+{
+    m_x.clear();
+    m_y.clear();
+    m_kind.clear();
+    m_bucketX.clear();
+    m_bucketY.clear();
+    m_next.clear();
+    m_prev.clear();
+    m_heads.assign(1024, -1);
+}
+
+int EntityLayer::add(float x, float y, Kind kind)
+{
+    if (m_heads.empty())
+        m_heads.assign(1024, -1);
+    int i = count();
+    m_x.push_back(x);
+    m_y.push_back(y);
+    m_kind.push_back(kind);
+    m_bucketX.push_back((int)floor(x) >> BucketShift);
+    m_bucketY.push_back((int)floor(y) >> BucketShift);
+    m_next.push_back(-1);
+    m_prev.push_back(-1);
+    // keep about one entity per hash slot
+    if (m_x.size() > m_heads.size())
+        rehash(m_heads.size() * 2);
+    else
+        link(i);
+    return i;
+}
+
+void EntityLayer::scatter(const WallMap &map, int count, uint64_t seed)
+{
+    Random random(seed);
+    // give up on maps with hardly any floor rather than loop forever
+    long attempts = (long)count * 64;
+    for (int added = 0; added < count && attempts > 0; attempts--)
+    {
+        int x = random.below(map.width());
+        int y = random.below(map.height());
+        if (map.isWall(x, y))
+            continue;
+        add(x + 0.25f + 0.5f * random.unit(), y + 0.25f + 0.5f * random.unit(), (Kind)random.below(KindCount));
+        added++;
+    }
+}
+
+void EntityLayer::setPosition(int i, float x, float y)
+{
+    m_x[i] = x;
+    m_y[i] = y;
+    int bucketX = (int)floor(x) >> BucketShift;
+    int bucketY = (int)floor(y) >> BucketShift;
+    if (bucketX == m_bucketX[i] && bucketY == m_bucketY[i])
+        return;
+    unlink(i);
+    m_bucketX[i] = bucketX;
+    m_bucketY[i] = bucketY;
+    link(i);
+}
+
+void EntityLayer::rebucket(int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        int bucketX = (int)floor(m_x[i]) >> BucketShift;
+        int bucketY = (int)floor(m_y[i]) >> BucketShift;
+        if (bucketX == m_bucketX[i] && bucketY == m_bucketY[i])
+            continue;
+        unlink(i);
+        m_bucketX[i] = bucketX;
+        m_bucketY[i] = bucketY;
+        link(i);
+    }
+}
+
+void EntityLayer::link(int i)
+{
+    int slot = slotOf(m_bucketX[i], m_bucketY[i]);
+    int head = m_heads[slot];
+    m_prev[i] = -1;
+    m_next[i] = head;
+    if (head >= 0)
+        m_prev[head] = i;
+    m_heads[slot] = i;
+}
+
+void EntityLayer::unlink(int i)
+{
+    if (m_prev[i] >= 0)
+        m_next[m_prev[i]] = m_next[i];
+    else
+        m_heads[slotOf(m_bucketX[i], m_bucketY[i])] = m_next[i];
+    if (m_next[i] >= 0)
+        m_prev[m_next[i]] = m_prev[i];
+}
+
+void EntityLayer::rehash(size_t slots)
+{
+    m_heads.assign(slots, -1);
+    for (int i = 0; i < count(); i++)
+        link(i);
+}
+
+void EntityLayer::collect(const Camera &camera, const float *depthBuffer, float depth, int width, int height)
+{
+    m_visible.clear();
+    m_stats = DrawStats();
+    if (m_x.empty() || width <= 0)
+        return;
+
+    // Nothing behind the farthest wall can be seen
+    float reach = min(depth, *max_element(depthBuffer, depthBuffer + width)) + Size;
+    float forwardX = sin(camera.angle), forwardY = cos(camera.angle);
+    float halfFov = camera.fov / 2;
+    const float columnsPerRadian = width / camera.fov;
+
+    // An entity drawn in a column is nearer than that column's wall and
+    // its centre is at most a column and Size away from the column. So
+    // the buckets to look at are the ones under the floor the rays cross:
+    // each column's wedge out to the farthest wall of it and its
+    // neighbours, widened by Size. The outline of those wedges is a
+    // staircase around the camera, filled a row of buckets at a time.
+    m_outline.clear();
+    m_outline.push_back({ camera.x, camera.y });
+    float stepSin = sin(1 / columnsPerRadian), stepCos = cos(1 / columnsPerRadian);
+    float raySin = sin(camera.angle - halfFov), rayCos = cos(camera.angle - halfFov);
+    for (int x = 0; x < width; x++)
+    {
+        float reachX = depthBuffer[x];
+        if (x > 0)
+            reachX = max(reachX, depthBuffer[x - 1]);
+        if (x < width - 1)
+            reachX = max(reachX, depthBuffer[x + 1]);
+        reachX = min(reachX, depth);
+        // the column's left edge ray, then its right one, which is the
+        // next column's left edge
+        m_outline.push_back({ camera.x + raySin * reachX, camera.y + rayCos * reachX });
+        float nextSin = raySin * stepCos + rayCos * stepSin;
+        rayCos = rayCos * stepCos - raySin * stepSin;
+        raySin = nextSin;
+        m_outline.push_back({ camera.x + raySin * reachX, camera.y + rayCos * reachX });
+    }
+
+    float minY = camera.y, maxY = camera.y;
+    for (const Point &point : m_outline)
+    {
+        minY = min(minY, point.y);
+        maxY = max(maxY, point.y);
+    }
+    int bucketMinY = (int)floor(minY - Size) >> BucketShift;
+    int bucketMaxY = (int)floor(maxY + Size) >> BucketShift;
+    m_spanBegin.assign(bucketMaxY - bucketMinY + 1, INT_MAX);
+    m_spanEnd.assign(bucketMaxY - bucketMinY + 1, INT_MIN);
+    for (size_t i = 0; i < m_outline.size(); i++)
+    {
+        // every row of buckets gets the buckets from the leftmost to the
+        // rightmost edge crossing it, each edge widened by Size
+        const Point &a = m_outline[i], &b = m_outline[(i + 1) % m_outline.size()];
+        float top = min(a.y, b.y) - Size, bottom = max(a.y, b.y) + Size;
+        for (int row = (int)floor(top) >> BucketShift; row <= (int)floor(bottom) >> BucketShift; row++)
+        {
+            float rowTop = (float)(row << BucketShift) - Size;
+            float rowBottom = rowTop + BucketSize + 2 * Size;
+            float left = min(a.x, b.x), right = max(a.x, b.x);
+            if (a.y != b.y)
+            {
+                // the part of the edge inside the widened row
+                float t0 = min(1.0f, max(0.0f, (rowTop - a.y) / (b.y - a.y)));
+                float t1 = min(1.0f, max(0.0f, (rowBottom - a.y) / (b.y - a.y)));
+                float x0 = a.x + (b.x - a.x) * t0, x1 = a.x + (b.x - a.x) * t1;
+                left = min(x0, x1);
+                right = max(x0, x1);
+            }
+            int span = row - bucketMinY;
+            m_spanBegin[span] = min(m_spanBegin[span], (int)floor(left - Size) >> BucketShift);
+            m_spanEnd[span] = max(m_spanEnd[span], (int)floor(right + Size) >> BucketShift);
+        }
+    }
+
+    for (int bucketY = bucketMinY; bucketY <= bucketMaxY; bucketY++)
+        for (int bucketX = m_spanBegin[bucketY - bucketMinY]; bucketX <= m_spanEnd[bucketY - bucketMinY]; bucketX++)
+        {
+            m_stats.bucketsVisited++;
+            for (int i = m_heads[slotOf(bucketX, bucketY)]; i >= 0; i = m_next[i])
+            {
+                // other buckets can share the hash slot
+                if (m_bucketX[i] != bucketX || m_bucketY[i] != bucketY)
+                    continue;
+                m_stats.considered++;
+                float ex = m_x[i] - camera.x, ey = m_y[i] - camera.y;
+                float entityForward = ex * forwardX + ey * forwardY;
+                if (entityForward < 0.1f)
+                    continue;
+                float distance = sqrt(ex * ex + ey * ey);
+                if (distance > reach)
+                    continue;
+
+                // same projection as the walls: columns by angle, the
+                // bottom on the floor line of a wall at that distance
+                float angle = atan2(ex * forwardY - ey * forwardX, entityForward);
+                float centre = (angle + halfFov) * columnsPerRadian;
+                float halfWidth = max(0.5f, Size / 2 / distance * columnsPerRadian);
+                int rowEnd = min(height, (int)(height / 2.0f + height / distance) + 1);
+                int rows = max(1, (int)(Size * 2 * height / distance));
+                Visible visible;
+                visible.distance = distance;
+                visible.index = i;
+                visible.columnBegin = max(0, (int)floor(centre - halfWidth + 0.5f));
+                visible.columnEnd = min(width, (int)floor(centre + halfWidth + 0.5f));
+                visible.rowBegin = max(0, rowEnd - rows);
+                visible.rowEnd = rowEnd;
+                if (visible.columnBegin < visible.columnEnd && visible.rowBegin < visible.rowEnd)
+                    m_visible.push_back(visible);
+            }
+        }
+
+    sort(m_visible.begin(), m_visible.end(),
+         [](const Visible &a, const Visible &b) { return a.distance > b.distance; });
+}
+
+void EntityLayer::draw(const Camera &camera, const float *depthBuffer, float depth, FrameBuffer &frame,
+                       const function<void(int, int)> &overdraw)
+{
+    static const wchar_t glyphs[KindCount] = { L'*', L'@', L'!' };
+    collect(camera, depthBuffer, depth, frame.width(), frame.height());
+    // far to near, so nearer entities cover farther ones
+    for (const Visible &visible : m_visible)
+    {
+        wchar_t glyph = glyphs[m_kind[visible.index]];
+        bool drawn = false;
+        int runBegin = -1;
+        for (int column = visible.columnBegin; column <= visible.columnEnd; column++)
+        {
+            bool inFront = column < visible.columnEnd && visible.distance < depthBuffer[column];
+            if (inFront)
+            {
+                for (int row = visible.rowBegin; row < visible.rowEnd; row++)
+                    frame.set(column, row, glyph, EntityColor);
+                if (runBegin < 0)
+                    runBegin = column;
+                drawn = true;
+            }
+            else if (runBegin >= 0)
+            {
+                overdraw(runBegin, column);
+                runBegin = -1;
+            }
+        }
+        m_stats.drawn += drawn;
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "FrameBuffer.h"
+#include "WallMap.h"
+
+struct Camera;
+
+// Billboard entities (pickups, NPCs, markers) standing in the world.
+//
+// Entities are stored as a structure of arrays, one array per field, so
+// code that updates positions only streams through the positions. They are
+// also linked into a spatial hash of BucketSize x BucketSize cell buckets,
+// so drawing a frame only looks at the buckets inside the view and never
+// at the whole list, and the hash table grows with the entity count
+// rather than with the map size.
+class EntityLayer
+{
+public:
+    enum Kind : uint8_t
+    {
+        Pickup,
+        Npc,
+        Marker,
+        KindCount
+    };
+    static const char *kindName(Kind kind);
+
+    static const int BucketShift = 2;       // 4x4 cells per bucket
+    static const int BucketSize = 1 << BucketShift;
+    static constexpr float Size = 0.5f;     // width and height in cells
+    static const short EntityColor = 5;     // colour pair the entities are drawn with
+
+    // Work done by the last draw()
+    struct DrawStats
+    {
+        int bucketsVisited = 0;
+        int considered = 0;     // entities in the visited buckets
+        int drawn = 0;          // entities at least partly in front of a wall
+    };
+
+    void clear();
+    // index of the new entity
+    int add(float x, float y, Kind kind);
+    // Add count entities of random kinds on random floor cells of map
+    void scatter(const WallMap &map, int count, uint64_t seed);
+    // Move entity i, relinking it only when it changes bucket
+    void setPosition(int i, float x, float y);
+    // For moving many entities at once, from several threads if need be:
+    // write the positions through xs() and ys(), then call rebucket() for
+    // the entities that were moved
+    std::vector<float> &xs() { return m_x; }
+    std::vector<float> &ys() { return m_y; }
+    void rebucket(int begin, int end);
+
+    int count() const { return (int)m_x.size(); }
+    float x(int i) const { return m_x[i]; }
+    float y(int i) const { return m_y[i]; }
+    Kind kind(int i) const { return (Kind)m_kind[i]; }
+    const std::vector<float> &xs() const { return m_x; }
+    const std::vector<float> &ys() const { return m_y; }
+
+    // Draw the entities in view over a rendered frame. depthBuffer holds
+    // the distance to the wall in each column, entities are only drawn
+    // where they are nearer than that. Calls overdraw(begin, end) for each
+    // run of columns it drew into.
+    void draw(const Camera &camera, const float *depthBuffer, float depth, FrameBuffer &frame,
+              const std::function<void(int, int)> &overdraw);
+    const DrawStats &stats() const { return m_stats; }
+
+private:
+    struct Point
+    {
+        float x, y;
+    };
+    struct Visible
+    {
+        float distance;
+        int index;
+        int columnBegin, columnEnd;
+        int rowBegin, rowEnd;
+    };
+    // find the entities in view, nearest last, and their screen rectangles
+    void collect(const Camera &camera, const float *depthBuffer, float depth, int width, int height);
+
+    int slotOf(int bucketX, int bucketY) const
+    {
+        uint32_t hash = (uint32_t)bucketX * 73856093u ^ (uint32_t)bucketY * 19349663u;
+        return (int)(hash & (uint32_t)(m_heads.size() - 1));
+    }
+    void link(int i);
+    void unlink(int i);
+    void rehash(size_t slots);
+
+private:
+    // one entry per entity
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<uint8_t> m_kind;
+    std::vector<int> m_bucketX;
+    std::vector<int> m_bucketY;
+    std::vector<int> m_next;        // next and previous entity in the same hash slot
+    std::vector<int> m_prev;
+
+    std::vector<int> m_heads;       // first entity of each hash slot, -1 if none
+    std::vector<Visible> m_visible;
+    DrawStats m_stats;
+
+    // floor the rays cross and the bucket spans inside it, kept by collect()
+    std::vector<Point> m_outline;
+    std::vector<int> m_spanBegin;   // buckets [begin, end] of each bucket row
+    std::vector<int> m_spanEnd;
+};
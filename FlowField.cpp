@@ -0,0 +1,104 @@
+#include "FlowField.h"
+#include <utility>
+
+using namespace std;
+
+bool FlowField::update(const WallMap &map, int targetX, int targetY, int budget)
+{
+    if (map.width() != m_width || map.height() != m_height)
+    {
+        m_width = map.width();
+        m_height = map.height();
+        size_t cells = (size_t)m_width * m_height;
+        for (Field *field : { &m_front, &m_back })
+        {
+            field->stamps.assign(cells, 0);
+            field->directions.assign(cells, None);
+            field->search = 0;
+            field->targetX = field->targetY = -1;
+            field->reached = 0;
+        }
+        m_searches = 0;
+        m_queue.clear();
+        m_head = 0;
+        invalidate();
+    }
+    if (!map.inBounds(targetX, targetY) || map.isWall(targetX, targetY))
+        return false;
+    if (targetX != m_front.targetX || targetY != m_front.targetY)
+        extend(targetX, targetY);
+    // a search in progress is finished first, so that a target that keeps
+    // moving cannot starve it
+    if (!searching() && (targetX != m_targetX || targetY != m_targetY))
+        start(targetX, targetY);
+    if (!searching())
+        return false;
+
+    // Neighbours are reached through the opposite side, so a cell found
+    // from its east neighbour steps east
+    static const int offsets[4][2] = { { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+    static const Direction back[4] = { South, West, North, East };
+    uint32_t search = m_back.search;
+    for (int visited = 0; searching() && (budget <= 0 || visited < budget); visited++)
+    {
+        uint32_t cell = m_queue[m_head++];
+        int x = cell % m_width, y = cell / m_width;
+        for (int i = 0; i < 4; i++)
+        {
+            int nx = x + offsets[i][0], ny = y + offsets[i][1];
+            if (nx < 0 || ny < 0 || nx >= m_width || ny >= m_height)
+                continue;
+            uint32_t next = (uint32_t)ny * m_width + nx;
+            if (m_back.stamps[next] == search || map.isWall(nx, ny))
+                continue;
+            m_back.stamps[next] = search;
+            m_back.directions[next] = back[i];
+            m_queue.push_back(next);
+        }
+    }
+    if (searching())
+        return false;
+
+    m_back.reached = (int)m_queue.size();
+    swap(m_front, m_back);
+    return true;
+}
+
+void FlowField::extend(int targetX, int targetY)
+{
+    static const Direction steps[3][3] = { { None, North, None }, { West, None, East }, { None, South, None } };
+    int dx = targetX - m_front.targetX, dy = targetY - m_front.targetY;
+    if (m_front.targetX < 0 || dx < -1 || dx > 1 || dy < -1 || dy > 1 || steps[dy + 1][dx + 1] == None)
+        return;
+    // the old target was next to the new one, so everything that led to it
+    // still gets there with one more step
+    size_t oldTarget = (size_t)m_front.targetY * m_width + m_front.targetX;
+    size_t newTarget = (size_t)targetY * m_width + targetX;
+    m_front.directions[oldTarget] = steps[dy + 1][dx + 1];
+    m_front.stamps[newTarget] = m_front.search;
+    m_front.directions[newTarget] = None;
+    m_front.targetX = targetX;
+    m_front.targetY = targetY;
+}
+
+void FlowField::start(int targetX, int targetY)
+{
+    m_targetX = targetX;
+    m_targetY = targetY;
+    // the stamps of a search number that wraps around could be stale
+    if (++m_searches == 0)
+    {
+        for (Field *field : { &m_front, &m_back })
+            field->stamps.assign(field->stamps.size(), 0);
+        m_searches = 1;
+    }
+    m_back.search = m_searches;
+    m_back.targetX = targetX;
+    m_back.targetY = targetY;
+    uint32_t cell = (uint32_t)targetY * m_width + targetX;
+    m_back.stamps[cell] = m_back.search;
+    m_back.directions[cell] = None;
+    m_queue.clear();
+    m_queue.push_back(cell);
+    m_head = 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "WallMap.h"
+
+// Breadth first search from one target cell over the floor of a WallMap,
+// stored as the direction to step in from every reachable cell. Anything
+// following the directions reaches the target along a shortest path, and
+// looking up the next step is a single read whatever the number of
+// followers.
+//
+// The search only runs again when the target moves to another cell or the
+// map changes, and it can be spread over several calls with a budget of
+// cells per call. The last finished field stays in use until the new one
+// is done. When the target steps into a neighbouring cell the old field is
+// patched straight away to lead on from the old target to the new one, so
+// followers never wait for the search. Both fields, and the search queue, keep their memory between
+// searches, and a search counter marks which cells the current search has
+// reached, so nothing is cleared between searches.
+class FlowField
+{
+public:
+    enum Direction : uint8_t { None, North, East, South, West };
+
+    // Carry on with the search in progress for up to budget cells (0 for
+    // no limit), or start one from cell x, y if that is not where the last
+    // one started. Returns true when a new field was finished by this call.
+    bool update(const WallMap &map, int targetX, int targetY, int budget = 0);
+    // the map changed, search again on the next update
+    void invalidate() { m_targetX = m_targetY = -1; }
+
+    // step to take from cell x, y, None at the target, on walls and on
+    // cells the target cannot be reached from
+    Direction direction(int x, int y) const
+    {
+        size_t cell = (size_t)y * m_width + x;
+        return m_front.stamps[cell] == m_front.search ? (Direction)m_front.directions[cell] : None;
+    }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int targetX() const { return m_front.targetX; }
+    int targetY() const { return m_front.targetY; }
+    bool searching() const { return m_head < m_queue.size(); }
+    // cells reached by the last finished search
+    int reached() const { return m_front.reached; }
+
+private:
+    struct Field
+    {
+        std::vector<uint32_t> stamps;       // number of the search that last reached the cell
+        std::vector<uint8_t> directions;
+        uint32_t search = 0;
+        int targetX = -1, targetY = -1;
+        int reached = 0;
+    };
+    void start(int targetX, int targetY);
+    // make the finished field lead on from its target to the neighbouring cell x, y
+    void extend(int targetX, int targetY);
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_targetX = -1;         // cell the search in progress (or the last one) started from
+    int m_targetY = -1;
+    uint32_t m_searches = 0;
+    Field m_front;              // what direction() reads
+    Field m_back;               // being searched
+    std::vector<uint32_t> m_queue;
+    size_t m_head = 0;
+};
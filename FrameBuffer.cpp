@@ -0,0 +1,91 @@
+#include "FrameBuffer.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+void FrameBuffer::resize(int width, int height)
+{
+    if (width == m_width && height == m_height)
+        return;
+    m_width = width;
+    m_height = height;
+    m_cells.assign(width * height, Cell());
+    m_presented.assign(width * height, Cell());
+    m_presentedValid = false;
+}
+
+void FrameBuffer::clear(wchar_t ch)
+{
+    for (auto &cell : m_cells)
+    {
+        cell.ch = ch;
+        cell.colorPair = 0;
+    }
+}
+
+void FrameBuffer::scrollColumns(int offset)
+{
+    if (offset == 0 || abs(offset) >= m_width)
+        return;
+    for (int y = 0; y < m_height; y++)
+    {
+        Cell *cells = row(y);
+        if (offset > 0)
+            copy(cells + offset, cells + m_width, cells);
+        else
+            copy_backward(cells, cells + m_width + offset, cells + m_width);
+    }
+}
+
+unsigned long long FrameBuffer::checksum() const
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    auto mix = [&](unsigned long long value, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+        {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+    for (const auto &cell : m_cells)
+    {
+        mix((unsigned long long)cell.ch, 4);
+        mix((unsigned long long)cell.colorPair, 2);
+    }
+    return hash;
+}
+
+bool FrameBuffer::nextChangedRun(int y, int from, int &begin, int &end) const
+{
+    if (!m_presentedValid)
+    {
+        // nothing presented yet, the whole row is a single run
+        if (from >= m_width)
+            return false;
+        begin = from;
+        end = m_width;
+        return true;
+    }
+
+    const Cell *current = row(y);
+    const Cell *presented = &m_presented[y * m_width];
+    int x = from;
+    while (x < m_width && current[x] == presented[x])
+        x++;
+    if (x == m_width)
+        return false;
+
+    begin = x;
+    while (x < m_width && current[x] != presented[x])
+        x++;
+    end = x;
+    return true;
+}
+
+void FrameBuffer::markPresented()
+{
+    m_presented = m_cells;
+    m_presentedValid = true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+
+// One character cell of the screen: a wide character and the colour pair
+// it is drawn with (0 is the terminal default)
+struct Cell
+{
+    wchar_t ch = ' ';
+    short colorPair = 0;
+
+    bool operator==(const Cell &other) const { return ch == other.ch && colorPair == other.colorPair; }
+    bool operator!=(const Cell &other) const { return !(*this == other); }
+};
+
+// Off-screen character surface filled by the renderer and pushed to the
+// terminal by the output layer. Remembers the last frame that was
+// presented so that only the cells that changed need to be sent again.
+class FrameBuffer
+{
+public:
+    void resize(int width, int height);
+    void clear(wchar_t ch = ' ');
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    void set(int x, int y, wchar_t ch, short colorPair = 0)
+    {
+        Cell &cell = m_cells[y * m_width + x];
+        cell.ch = ch;
+        cell.colorPair = colorPair;
+    }
+    const Cell &at(int x, int y) const { return m_cells[y * m_width + x]; }
+    Cell *row(int y) { return &m_cells[y * m_width]; }
+    const Cell *row(int y) const { return &m_cells[y * m_width]; }
+
+    // Move every row offset cells to the left (right if negative), column
+    // x + offset ends up in column x. The columns moved out of leave their
+    // old contents behind.
+    void scrollColumns(int offset);
+
+    // FNV-1a hash of every cell, used to spot output changes between runs
+    unsigned long long checksum() const;
+
+    // Find the next run of cells in row y, starting the search at column
+    // from, that differ from the last presented frame. Returns false when
+    // the rest of the row is unchanged.
+    bool nextChangedRun(int y, int from, int &begin, int &end) const;
+
+    // Remember the current contents as what the terminal now shows
+    void markPresented();
+    // Forget the presented frame so that the next present sends every cell
+    void invalidate() { m_presentedValid = false; }
+    bool presentedValid() const { return m_presentedValid; }
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<Cell> m_cells;
+    std::vector<Cell> m_presented;
+    bool m_presentedValid = false;
+};
@@ -1,19 +1,42 @@
 #include "Game.h"
 #include <cstdlib>
+#include <cstring>
 #include <locale.h>
 #include <cmath>
-#include <algorithm>
 #include <ctime>
+#include <algorithm>
+#include <functional>
 
 using namespace std;
 
-Game::Game()
+Game::Game(const GameOptions &options)
+    : m_threadPool(options.threads)
+    , m_mapFile(options.mapFile.empty() ? "map.fmap" : options.mapFile)
+    , m_targetFps(options.targetFps)
+    , m_idleWhenUnchanged(options.idle)
+    , m_mazeAlgorithm(options.generator)
+    , m_mazeSeed(options.seed ? options.seed : (unsigned)time(0))
+    , m_entityCount(options.entities)
+    , m_agentCount(options.agents)
 {
-    m_maze.resize(m_mazeWidth * m_mazeHeight, 0);
-    m_stack.push(make_pair(0, 0));
-    m_maze[0] = CELL_VISITED;
-    m_nVisitedCells = 1;
-    
+    m_mazeWidth = options.mazeWidth;
+    m_mazeHeight = options.mazeHeight;
+    m_renderer.setThreadPool(&m_threadPool);
+    m_renderer.setColumnCache(true);
+    m_renderer.setEntities(&m_entities);
+    m_renderer.setLightmap(&m_lightmap);
+    m_renderer.setTextures(&m_textureAtlas, &m_textureMap);
+    m_miniMap.setLightmap(&m_lightmap);
+    m_editorMap.setLightmap(&m_lightmap);
+    m_renderer.raycaster().setDistanceField(&m_distanceField);
+    m_governor.setBudget(options.renderBudget / 1000.0);
+    m_output = options.ansiOutput ? (OutputBackend *)&m_ansiOutput : &m_ncursesOutput;
+    if (!options.traceFile.empty() && !m_profiler.startTrace(options.traceFile))
+    {
+        printf("Could not write trace file %s\n", options.traceFile.c_str());
+        exit(1);
+    }
+
     setlocale(LC_ALL, "");
 	initscr();
     noecho();
@@ -24,30 +47,35 @@ Game::Game()
 		exit(1);
 	}
     start_color();
-	init_pair(1, COLOR_BLACK, COLOR_WHITE);
-    init_pair(2, COLOR_BLACK, COLOR_YELLOW);
-    init_pair(3, COLOR_BLACK, COLOR_BLUE);
-    init_pair(4, COLOR_WHITE, COLOR_BLACK);
-
-    m_screenWidth = COLS / 2;
-    m_screenHeight = m_screenWidth / 2;
-    m_screenStartPosY = (LINES - m_screenHeight) / 2;
-    m_screenStartPosX = (COLS - m_screenWidth) / 1.1;
-
-    m_gameWindow = newwin(m_screenHeight, m_screenWidth, m_screenStartPosY, m_screenStartPosX);
+    const short colorPairs[][3] =
+    {
+        { 1, COLOR_BLACK, COLOR_WHITE },
+        { 2, COLOR_BLACK, COLOR_YELLOW },
+        { 3, COLOR_BLACK, COLOR_BLUE },
+        { 4, COLOR_WHITE, COLOR_BLACK },
+        { EntityLayer::EntityColor, COLOR_YELLOW, COLOR_BLACK },
+    };
+    for (const auto &pair : colorPairs)
+    {
+        init_pair(pair[0], pair[1], pair[2]);
+        m_ansiOutput.definePair(pair[0], pair[1], pair[2]);
+    }
+    for (short pair = TextureAtlas::FirstColor; pair < TextureAtlas::ColorEnd; pair++)
+    {
+        short foreground, background;
+        TextureAtlas::colorPair(pair, foreground, background);
+        init_pair(pair, foreground, background);
+        m_ansiOutput.definePair(pair, foreground, background);
+    }
+    layoutScreen();
     // m_miniMapWindow = newwin(m_mazeHeight, m_mazeWidth * 2, 1, 0);
     // m_mapEditorWindow = newwin(m_mazeHeight, m_mazeWidth * 2, 1, 1);
-    m_mapWidth = m_mazeWidth * (m_pathWidth + 1) + 1;
-    m_mapHeight = m_mazeHeight * (m_pathWidth + 1) + 1;
-    m_depth = m_mapHeight;
-    m_map.resize(m_mapWidth * m_mapHeight, '#');
-    m_miniMapWindow = newwin(m_mapHeight, m_mapWidth * 2, 1, 1);
-    m_mapEditorWindow = newwin(m_mapHeight, m_mapWidth * 2, 1, 1);
-
-    nodelay(m_gameWindow, true);
 
-    
-    generateMaze();
+    // start on the given map file, or on a new maze that will be saved there
+    if (options.mapFile.empty() || !loadMap())
+        generateMaze();
+    else
+        mapChanged();
 
     
 }
@@ -59,63 +87,232 @@ Game::~Game()
 
 void Game::run()
 {
-    auto lastFrameTime = std::chrono::system_clock::now();
-    auto currentFrameTime = std::chrono::system_clock::now();
+    using Clock = chrono::steady_clock;
+    const auto tick = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / m_tickRate));
+    const auto frameInterval = m_targetFps > 0
+        ? chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / m_targetFps))
+        : Clock::duration::zero();
+
+    auto lastTick = Clock::now();
+    auto nextFrame = lastTick;
+    auto lastFrame = lastTick;
+    curs_set(0);
     while (m_running)
     {
-        currentFrameTime = chrono::system_clock::now();
-        chrono::duration<float> elapsedTime = currentFrameTime - lastFrameTime;
-        lastFrameTime = currentFrameTime;
-
         if (m_mapEditorMode) 
         {
             curs_set(1);
             editMap();
+            curs_set(0);
+            m_dirty = true;
+            lastTick = Clock::now();
+            continue;
         }
-        else 
+
+        // Sleep in wgetch until a key arrives or the next tick or frame is
+        // due. With nothing held and nothing to redraw just wait for a key.
+        auto now = Clock::now();
+        // agents keep the simulation going even when the player stands still
+        bool moving = isMoving(now) || !m_swarm.empty();
+        Clock::time_point wake;
+        if (moving)
+            wake = lastTick + tick;
+        else if (m_dirty || !m_idleWhenUnchanged)
+            wake = nextFrame;
+        else
+            wake = now + chrono::seconds(1);
+        // a maze being generated is applied as it arrives
+        if (m_mazeStreamer.active())
+            wake = min(wake, now + chrono::milliseconds(30));
+        int timeoutMs = max<long>(0, chrono::duration_cast<chrono::milliseconds>(wake - now + chrono::microseconds(999)).count());
+        gameControl(timeoutMs);
+        streamMaze();
+
+        // advance the simulation in fixed steps of the monotonic clock
+        now = Clock::now();
+        if (!moving)
+            lastTick = max(lastTick, now - tick);
+        for (int steps = 0; now - lastTick >= tick; steps++)
+        {
+            lastTick += tick;
+            if (steps == m_maxTicksPerFrame)
+            {
+                // too far behind (e.g. the process was stopped), drop the rest
+                lastTick = now;
+                break;
+            }
+            simulate(chrono::duration<float>(tick).count(), lastTick);
+        }
+
+        if ((m_dirty || !m_idleWhenUnchanged) && now >= nextFrame)
         {
-            curs_set(0);
-            gameControl(elapsedTime.count());
             gameRender();
+            m_dirty = false;
+            m_frameTime = chrono::duration<float>(now - lastFrame).count();
+            lastFrame = now;
+            nextFrame = max(nextFrame + frameInterval, now);
         }
     }
 }
 
-void Game::gameControl(float elapsedTime)
+bool Game::isMoving(chrono::steady_clock::time_point now) const
 {
-    bool isPlayerInMap = m_playerX >= 0 && m_playerX <= m_mapWidth && m_playerY >= 0 && m_playerY <= m_mapHeight;
-    wchar_t ch = wgetch(m_gameWindow);
-    switch(ch)
-    {
-    case 'a': case 'A': 
+    for (const auto &heldUntil : m_heldUntil)
+        if (heldUntil > now)
+            return true;
+    return false;
+}
+
+void Game::simulate(float elapsedTime, chrono::steady_clock::time_point now)
+{
+    auto held = [&](Action action) { return m_heldUntil[action] > now; };
+    float oldX = m_playerX, oldY = m_playerY, oldAngle = m_playerAngle;
+
+    if (held(ACTION_TURN_LEFT))
         m_playerAngle -= m_playerRotateSpeed * elapsedTime;
-        break;
-    case 'd': case 'D':
+    if (held(ACTION_TURN_RIGHT))
         m_playerAngle += m_playerRotateSpeed * elapsedTime;
-        break;
-    case 'w': case 'W':
-        m_playerX += sin(m_playerAngle) * m_playerMoveSpeed * elapsedTime;
-        m_playerY += cos(m_playerAngle) * m_playerMoveSpeed * elapsedTime;
+
+    float move = 0.0f;
+    if (held(ACTION_FORWARD))
+        move += m_playerMoveSpeed * elapsedTime;
+    if (held(ACTION_BACKWARD))
+        move -= m_playerMoveSpeed * elapsedTime;
+    if (move != 0.0f)
+    {
+        bool isPlayerInMap = m_playerX >= 0 && m_playerX <= m_mapWidth && m_playerY >= 0 && m_playerY <= m_mapHeight;
+        m_playerX += sin(m_playerAngle) * move;
+        m_playerY += cos(m_playerAngle) * move;
         // wall collision
-        if(!isPlayerInMap || m_map[(int)m_playerY * m_mapWidth + (int)m_playerX] == '#')
+        if(!isPlayerInMap || !m_map.inBounds((int)m_playerX, (int)m_playerY) || m_map.isWall((int)m_playerX, (int)m_playerY))
         {
-            m_playerX -= sin(m_playerAngle) * m_playerMoveSpeed * elapsedTime;
-            m_playerY -= cos(m_playerAngle) * m_playerMoveSpeed * elapsedTime;
+            m_playerX -= sin(m_playerAngle) * move;
+            m_playerY -= cos(m_playerAngle) * move;
         }
-        break;
-    case 's': case 'S':
-        m_playerX -= sin(m_playerAngle) * m_playerMoveSpeed * elapsedTime;
-        m_playerY -= cos(m_playerAngle) * m_playerMoveSpeed * elapsedTime;
-        // wall collision
-        if(!isPlayerInMap ||  m_map[(int)m_playerY * m_mapWidth + (int)m_playerX] == '#')
+    }
+
+    if (m_playerX != oldX || m_playerY != oldY || m_playerAngle != oldAngle)
+        m_dirty = true;
+
+    if (!m_swarm.empty())
+    {
+        // the field only searches again once the player is in another cell
+        Profiler::Scope scope(m_profiler, Profiler::Agents);
+        m_flowField.update(m_map, (int)m_playerX, (int)m_playerY, m_flowBudget);
+        m_swarm.update(m_entities, m_flowField, m_map, elapsedTime, &m_threadPool);
+        m_dirty = true;
+    }
+}
+
+void Game::gameControl(int timeoutMs)
+{
+    // The terminal only reports key presses, held keys arrive as auto
+    // repeats. Each press holds its action for m_keyHoldTime, which
+    // bridges the gap between repeats.
+    auto holdUntil = chrono::steady_clock::now()
+        + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<float>(m_keyHoldTime));
+
+    wtimeout(m_gameWindow, timeoutMs);
+    int ch = wgetch(m_gameWindow);
+    // time the handling of the keys, not the wait for the first one
+    Profiler::Scope scope(m_profiler, Profiler::Input);
+    for (; ch != ERR; ch = wgetch(m_gameWindow))
+    {
+        // only the first read waits, then drain whatever else is queued
+        wtimeout(m_gameWindow, 0);
+        switch(ch)
         {
-            m_playerX += sin(m_playerAngle) * m_playerMoveSpeed * elapsedTime;
-            m_playerY += cos(m_playerAngle) * m_playerMoveSpeed * elapsedTime;
+        case 'a': case 'A': 
+            m_heldUntil[ACTION_TURN_LEFT] = holdUntil;
+            break;
+        case 'd': case 'D':
+            m_heldUntil[ACTION_TURN_RIGHT] = holdUntil;
+            break;
+        case 'w': case 'W':
+            m_heldUntil[ACTION_FORWARD] = holdUntil;
+            break;
+        case 's': case 'S':
+            m_heldUntil[ACTION_BACKWARD] = holdUntil;
+            break;
+        default:
+            handleKey(ch);
+            m_dirty = true;
+            break;
         }
-        break;
+    }
+}
+
+void Game::handleKey(int ch)
+{
+    switch(ch)
+    {
     case 'm': case 'M':
         m_mapEditorMode = true;
         break;
+    case 'r': case 'R':
+    {
+        // cycle through DDA, DDA with distance field leaps and the legacy
+        // fixed step ray march for A/B runs
+        Raycaster &raycaster = m_renderer.raycaster();
+        if (raycaster.mode() == Raycaster::Mode::DDA)
+            raycaster.setMode(Raycaster::Mode::Field);
+        else if (raycaster.mode() == Raycaster::Mode::Field)
+            raycaster.setMode(Raycaster::Mode::Legacy);
+        else
+            raycaster.setMode(Raycaster::Mode::DDA);
+        updateDistanceField();
+        break;
+    }
+    case 'v': case 'V':
+    {
+        // cycle through the ray packet kernels this CPU supports
+        Raycaster &raycaster = m_renderer.raycaster();
+        Raycaster::Kernel kernel = raycaster.kernel();
+        do
+            kernel = kernel == Raycaster::Kernel::Scalar ? Raycaster::Kernel::SSE
+                   : kernel == Raycaster::Kernel::SSE ? Raycaster::Kernel::AVX2
+                   : Raycaster::Kernel::Scalar;
+        while (!Raycaster::kernelSupported(kernel));
+        raycaster.setKernel(kernel);
+        break;
+    }
+    case 'b': case 'B':
+        // switch between ncurses and writing escape sequences directly
+        if (m_output == &m_ncursesOutput)
+            m_output = &m_ansiOutput;
+        else
+            m_output = &m_ncursesOutput;
+        clearScreen();
+        break;
+    case 'h': case 'H':
+        // profiling HUD, clear the screen to take it away again
+        m_profiler.setHudVisible(!m_profiler.hudVisible());
+        clearScreen();
+        break;
+    case 'n': case 'N':
+        // shrink the whole map into the minimap, or go back to the cells around the player
+        m_miniMap.setOverview(!m_miniMap.overview());
+        break;
+    case 'k': case 'K':
+        // keep the column hits between frames, or trace every column every frame
+        m_renderer.setColumnCache(!m_renderer.columnCache());
+        break;
+    case 'u': case 'U':
+        // compare with the previous frame and only send the cells that changed
+        m_sendChangedCellsOnly = !m_sendChangedCellsOnly;
+        break;
+    case KEY_RESIZE:
+        // lay the windows out again, the frame and the render tables
+        // follow the new size on the next frame
+        layoutScreen();
+        clearScreen();
+        break;
+    case 't': case 'T':
+        // textured or flat shaded walls
+        m_textured = !m_textured;
+        m_renderer.setTextures(m_textured ? &m_textureAtlas : nullptr, &m_textureMap);
+        m_renderer.invalidateColumns();
+        break;
     default:
         break;
     }
@@ -123,266 +320,256 @@ void Game::gameControl(float elapsedTime)
 
 void Game::gameRender()
 {
-    for(int x = 0; x <= m_screenWidth; ++x)
+    Camera camera;
+    camera.x = m_playerX;
+    camera.y = m_playerY;
+    camera.angle = m_playerAngle;
+    camera.fov = m_FOV;
+    m_frame.resize(m_screenWidth, m_screenHeight);
     {
-        // For each screen column calculate the projected ray angle into world space
-        float rayAngle = 
-            (m_playerAngle - m_FOV / 2) + ((float)x / (float)m_screenWidth) * m_FOV;
-        float distanceToWall = 0;
-        bool hittingWall = false;
-        bool isBoundary = false;
-
-        // unit vector for ray in player space(sin^2 + cos^2 = 1)
-        float eyeX = sin(rayAngle);
-        float eyeY = cos(rayAngle);
-
-        while(!hittingWall && distanceToWall < m_depth)
-        {
-            distanceToWall += 0.1;
-            int testX = m_playerX + eyeX * distanceToWall;
-            int testY = m_playerY + eyeY * distanceToWall;
-
-            // test if ray is out of boundary
-            if(testX < 0 || testX >= m_mapWidth || testY < 0 || testY >= m_mapHeight)
-            {
-                hittingWall = true;                // Just set distance to maximum depth
-                distanceToWall = m_depth;
-            }
-            else
-            {
-                // Ray is inbounds so test to see if the ray cell is a wall block
-                if(m_map[testY * m_mapWidth + testX] == '#') 
-                {
-                    hittingWall = true;
-
-                    // To highlight tile boundaries, cast a ray from each corner
-                    // of the tile, to the player. The more coincident this ray
-                    // is to the rendering ray, the closer we are to a tile 
-                    // boundary, which we'll shade to add detail to the walls
-                    vector<pair<float, float>> p;
-
-                    // Test each corner of hit tile, storing the distance from
-                    // the player, and the calculated dot product of the two rays
-                    for (int tx = 0; tx < 2; tx++)
-                        for (int ty = 0; ty < 2; ty++)
-                        {
-                            // Angle of corner to eye
-                            float vy = (float)testY + ty - m_playerY;
-                            float vx = (float)testX + tx - m_playerX;
-                            float d = sqrt(vx*vx + vy*vy); 
-                            float dot = (eyeX * vx / d) + (eyeY * vy / d);
-                            p.push_back(make_pair(d, dot));
-                        }
-
-                    // Sort Pairs from closest to farthest
-                    sort(p.begin(), p.end(), [](const pair<float, float> &left, const pair<float, float> &right) { return left.first < right.first; });
-                    
-                    // First two/three are closest (we will never see all four)
-                    float fBound = 0.005;
-                    if (acos(p.at(0).second) < fBound) isBoundary = true;
-                    if (acos(p.at(1).second) < fBound) isBoundary = true;
-                    // if (acos(p.at(2).second) < fBound) isBoundary = true;
-                }
-            }
-        }
+        Profiler::Scope scope(m_profiler, Profiler::Render);
+        m_renderer.setTiming(m_profiler.enabled());
+        m_renderer.setColumnStep(m_governor.columnStep());
+        auto start = chrono::steady_clock::now();
+        m_renderer.render(camera, m_map, m_depth * m_governor.depthScale(), m_frame);
+        m_governor.update(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    const RenderStats &stats = m_renderer.stats();
+    m_profiler.addSeconds(Profiler::RayCast, stats.castSeconds);
+    m_profiler.addSeconds(Profiler::Shading, stats.shadeSeconds);
+    m_profiler.addRays(stats.raySteps, stats.maxRaySteps, stats.wallHits);
+
+    // the box and status only need sending again when they changed or the
+    // screen was cleared
+    bool redrawAll = !m_frame.presentedValid();
+    m_output->beginFrame();
+    {
+        Profiler::Scope scope(m_profiler, Profiler::Present);
+        m_output->presentFrame(m_frame, m_screenStartPosX, m_screenStartPosY, m_sendChangedCellsOnly);
+        if (redrawAll)
+            m_output->drawBox(m_screenStartPosX, m_screenStartPosY, m_screenWidth, m_screenHeight);
+    }
 
-        // Calculate distance to celling and floor
-        int nCelling = m_screenHeight / 2.0f - m_screenHeight / distanceToWall;
-        int nFloor = m_screenHeight - nCelling;
+    // display status
+    const Raycaster &raycaster = m_renderer.raycaster();
+    char status[256];
+    snprintf(status, sizeof(status), "X:%f, Y:%f, A:%f, RAY:%-6s SIMD:%-6s OUT:%-4s CACHE:%-4d ENT:%-4d SCALE:1/%d %3d%% FPS:%-5.1f TERM:%s %ldB/%dW   ",
+        m_playerX, m_playerY, m_playerAngle * 360.0f / 3.14159265,
+        Raycaster::modeName(raycaster.mode()), Raycaster::kernelName(raycaster.kernel()),
+        m_sendChangedCellsOnly ? "DIFF" : "FULL",
+        m_renderer.columnCache() ? stats.columnsTraced : -1, stats.entitiesDrawn,
+        m_governor.columnStep(), (int)(m_governor.depthScale() * 100 + 0.5f), m_frameTime > 0 ? 1.0f / m_frameTime : 0.0f,
+        m_output->name(), m_output->stats().bytes, m_output->stats().syscalls);
+    if (redrawAll || m_status != status)
+    {
+        m_output->drawText(0, 0, status);
+        m_status = status;
+    }
 
-        // Shader walls based on distance
-        wchar_t nShade = ' ';
-        if (distanceToWall <= m_depth / 4.0f)			nShade = 0x2588;	// Very close	
-        else if (distanceToWall < m_depth / 3.0f)		nShade = 0x2593;
-        else if (distanceToWall < m_depth / 2.0f)		nShade = 0x2592;
-        else if (distanceToWall < m_depth)				nShade = 0x2591;
-        else											nShade = ' ';		// Too far away
+    {
+        Profiler::Scope scope(m_profiler, Profiler::MiniMap);
+        mapRender(*m_output, m_miniMap, 1, 1, m_playerX, m_playerY);
+    }
+    if (m_profiler.hudVisible())
+        hudRender();
+    {
+        Profiler::Scope scope(m_profiler, Profiler::Flush);
+        m_output->endFrame();
+    }
+    m_profiler.endFrame();
+}
 
-        if (isBoundary)		nShade = ' '; // Black it out
+void Game::hudRender()
+{
+    // averages of the last frames, in the bottom lines under the minimap
+    Profiler::Frame average = m_profiler.average();
+    auto ms = [&](Profiler::Section section) { return average.seconds[section] * 1e3; };
+    char line[256];
+    snprintf(line, sizeof(line), "FRAME %6.2fms  INPUT %5.2f  AGENTS %5.2f  RENDER %5.2f  MINIMAP %5.2f  PRESENT %5.2f  FLUSH %5.2f  (ms, last %d frames)   ",
+        average.duration * 1e3, ms(Profiler::Input), ms(Profiler::Agents), ms(Profiler::Render), ms(Profiler::MiniMap),
+        ms(Profiler::Present), ms(Profiler::Flush), Profiler::AverageFrames);
+    m_output->drawText(0, LINES - 3, line);
+    snprintf(line, sizeof(line), "RAYCAST %5.2f  SHADING %5.2f  (ms summed over %d threads)   ",
+        ms(Profiler::RayCast), ms(Profiler::Shading), m_threadPool.threadCount());
+    m_output->drawText(0, LINES - 2, line);
+    snprintf(line, sizeof(line), "RAY STEPS %8ld  LONGEST RAY %5d  WALL HITS %5d   ",
+        average.raySteps, average.maxRaySteps, average.wallHits);
+    m_output->drawText(0, LINES - 1, line);
+}
 
-        for(int y = 0; y < m_screenHeight; ++y)
-        {
-            if(y < nCelling)
-                mvwprintw(m_gameWindow, y, x, "%lc", ' ');
-            else if(y >= nCelling && y <= nFloor)
-                mvwprintw(m_gameWindow, y, x, "%lc", nShade);
-            else
-            {
-                // shade floor based on distance
-                float b = 1.0f - (y - m_screenHeight / 2.0f) / (m_screenHeight / 2.0f);
-                if(b < 0.25f)        nShade = '=';
-                else if(b < 0.5f)    nShade = '~';
-                else if(b < 0.75f)   nShade = '.';
-                else if(b < 0.9f)    nShade = '-';
-                else                 nShade = ' ';
-                
-                mvwprintw(m_gameWindow, y, x, "%lc", nShade);
-            }
-        }
-    }
-    box(m_gameWindow, 0, 0);
+void Game::mapRender(OutputBackend &output, MiniMap &miniMap, int left, int top, int focusX, int focusY)
+{
+    // only send what the minimap redrew
+    miniMap.update(m_map, focusX, focusY, m_playerX, m_playerY);
+    miniMap.present(output, left, top);
+}
 
-    // display status
-    mvprintw(0, 0, "X:%f, Y:%f, A:%f", m_playerX, m_playerY, m_playerAngle * 360.0f / 3.14159265);
-    
-    refresh();
-    mapRender(m_miniMapWindow);
-    wrefresh(m_gameWindow);
+void Game::cellEdited(int x, int y)
+{
+    m_miniMap.cellChanged(x, y);
+    m_editorMap.cellChanged(x, y);
+    m_renderer.invalidateCell(x, y);
+    if (m_distanceFieldValid)
+        m_distanceField.cellChanged(m_map, x, y);
+    m_flowField.invalidate();
 }
 
-void Game::mapRender(WINDOW *window)
+void Game::mapEdited(const MapEditor::Edit &edit)
 {
-    string display_map = m_map;
-    int playerIdx = (int)m_playerY * m_mapWidth + (int)m_playerX;
-    display_map[playerIdx] = 'P';
-    for(int x = 0; x < m_mapWidth; x++) 
+    if (!m_lightmap.empty())
     {
-        for(int y = 0; y < m_mapHeight; y++) 
-        {
-            // int displayX = m_mapWidth - x - 1;
-            if (display_map[y * m_mapWidth + x] == '#') 
-            {
-                wattron(window, COLOR_PAIR(1));
-                mvwaddstr(window, y, 2 * x, "  ");
-                wattroff(window, COLOR_PAIR(1));
-            }
-            else if (display_map[y * m_mapWidth + x] == 'P') 
-            {
-                wattron(window, COLOR_PAIR(2));
-                mvwaddstr(window, y, 2 * x, "  ");
-                wattroff(window, COLOR_PAIR(2));
-            }
-            else 
-            {
-               mvwaddstr(window, y, 2 * x, "  "); 
-            }
-        }  
+        m_lightmap.wallsChanged(m_map, edit.left, edit.top, edit.right, edit.bottom, &m_threadPool);
+        lightmapBaked();
+    }
+    // a few cells are followed one at a time, a big edit repaints its
+    // rectangle and rebuilds what depends on the whole map
+    if (edit.cells <= m_smallEdit)
+    {
+        for (const auto &run : edit.runs)
+            for (int x = run.x; x < run.x + run.length; x++)
+                cellEdited(x, run.y);
+        return;
     }
-    wrefresh(window);
+    m_miniMap.regionChanged(edit.left, edit.top, edit.right, edit.bottom);
+    m_editorMap.regionChanged(edit.left, edit.top, edit.right, edit.bottom);
+    m_renderer.invalidateColumns();
+    m_distanceFieldValid = false;
+    updateDistanceField();
+    m_flowField.invalidate();
 }
 
-void Game::generateMaze()
+void Game::updateDistanceField()
 {
-    srand(time(0));
-
-    while (!m_stack.empty())
-        m_stack.pop();
-    for (auto &state : m_maze) 
-        state = 0;
+    // only built while it is used, it takes a byte per cell
+    if (m_renderer.raycaster().mode() != Raycaster::Mode::Field || m_distanceFieldValid)
+        return;
+    m_distanceField.build(m_map);
+    m_distanceFieldValid = true;
+}
 
-    m_stack.push(make_pair(0, 0));
-    m_maze[0] = CELL_VISITED;
-    m_nVisitedCells = 1;
+void Game::generateMaze()
+{
+    // the map starts out all walls and the maze is carved into it as the
+    // worker hands it over. Carving only takes walls away, so the distance
+    // field built now stays a safe underestimate until it is rebuilt at
+    // the end, and the player's cell is carved in the first batch.
+    m_lightmap.clear();
+    m_mazeStreamer.start(m_map, m_mazeWidth, m_mazeHeight, m_pathWidth, m_mazeSeed++, m_mazeAlgorithm);
+    m_textureMap.resize(m_map.width(), m_map.height());
     m_playerX = 1.0f;
     m_playerY = 1.0f;
-    // do the maze algorithm
-    while (m_nVisitedCells < m_mazeWidth * m_mazeHeight)
-    {
-        int top_x = m_stack.top().first;
-        int top_y = m_stack.top().second;
-        auto offset = [&](int x, int y) 
-        {
-            return (top_y + y) * m_mazeWidth + (top_x + x);
-        };
-        // step 1: create a set of the unvisited neighbours
-        vector<int> neighbours;
-        // north neighbour
-        if (top_y > 0 && (m_maze[offset(0, -1)] & CELL_VISITED) == 0)
-        {
-            neighbours.push_back(0);
-        }
-        // east neighbour
-        if (top_x < m_mazeWidth - 1 && (m_maze[offset(1, 0)] & CELL_VISITED) == 0)
-        {
-            neighbours.push_back(1);
-        }
-        // south neighbour
-        if (top_y < m_mazeHeight - 1 && (m_maze[offset(0, 1)] & CELL_VISITED) == 0)
-        {
-            neighbours.push_back(2);
-        }
-        // west neighbour
-        if (top_x > 0 && (m_maze[offset(-1, 0)] & CELL_VISITED) == 0)
-        {
-            neighbours.push_back(3);
-        }
+    mapChanged();
+    streamMaze();
+}
 
-        // Are there any neighbour available?
-        if (!neighbours.empty()) 
-        {
-            // Choose a neighbour randomly
-            int next_cell_dir = neighbours[rand() % neighbours.size()];
-            // Create a path between the neighbour and the current cell
-            switch (next_cell_dir)
-            {
-            case 0: // North
-                m_maze[offset(0, 0)] |= CELL_PATH_N;
-                m_maze[offset(0, -1)] |= CELL_VISITED | CELL_PATH_S;
-                m_stack.push(make_pair(top_x, top_y - 1));
-                break;
-            case 1: // East
-                m_maze[offset(0, 0)] |= CELL_PATH_E;
-                m_maze[offset(1, 0)] |= CELL_VISITED | CELL_PATH_W;
-                m_stack.push(make_pair(top_x + 1, top_y));
-                break;
-            case 2: // South
-                m_maze[offset(0, 0)] |= CELL_PATH_S;
-                m_maze[offset(0, 1)] |= CELL_VISITED | CELL_PATH_N;
-                m_stack.push(make_pair(top_x, top_y + 1));
-                break;
-            case 3: // West
-                m_maze[offset(0, 0)] |= CELL_PATH_W;
-                m_maze[offset(-1, 0)] |= CELL_VISITED | CELL_PATH_E;
-                m_stack.push(make_pair(top_x - 1, top_y));
-                break;
-            }
-            m_nVisitedCells++;
-        }
-        else
-        {
-            // no neighbour available -> back track
-            m_stack.pop(); // backtrack
-        }
+bool Game::streamMaze()
+{
+    if (!m_mazeStreamer.active())
+        return false;
+    int left, top, right, bottom;
+    bool changed = m_mazeStreamer.apply(m_map, left, top, right, bottom);
+    if (!m_mazeStreamer.active())
+    {
+        // the whole maze is in, now scatter the entities and build the fields
+        mapChanged();
+        return true;
     }
+    if (!changed)
+        return false;
+    m_miniMap.regionChanged(left, top, right, bottom);
+    m_editorMap.regionChanged(left, top, right, bottom);
+    m_renderer.invalidateColumns();
+    m_flowField.invalidate();
+    m_dirty = true;
+    return true;
+}
 
-    // generate the maze
-    for (auto &c : m_map)
-        c = '#';
+bool Game::loadMap()
+{
+    PlayerStart start;
+    if (!m_map.load(m_mapFile, start))
+        return false;
+    m_playerX = start.x;
+    m_playerY = start.y;
+    m_playerAngle = start.angle;
+    // the lights are baked again unless the cached bake is for this map
+    bool cached;
+    m_lightmap.load(m_mapFile + ".light", m_map, &m_threadPool, cached);
+    m_textureMap.load(m_mapFile + ".tex", m_map.width(), m_map.height());
+    mapChanged();
+    return true;
+}
 
-    for (int x = 0; x < m_mazeWidth; x++) 
-    {
-        for (int y = 0; y < m_mazeHeight; y++) 
-        {
-            for (int px = 0; px < m_pathWidth; px++)
-            {
-                for (int py = 0; py < m_pathWidth; py++)
-                {
-                    if (m_maze[y * m_mazeWidth + x] & CELL_VISITED) 
-                    {
-                        int mapY = y * (m_pathWidth + 1) + py + 1;
-                        int mapX = x * (m_pathWidth + 1) + px + 1;
-                        m_map[mapY * m_mapWidth + mapX] = ' ';
-                    }
-                }
-            }
-            
-            for (int p = 0; p < m_pathWidth; p++) 
-            {
-                if (m_maze[y * m_mazeWidth + x] & CELL_PATH_S)
-                {
-                    int mapY = y * (m_pathWidth + 1) + m_pathWidth + 1;
-                    int mapX = x * (m_pathWidth + 1) + p + 1;
-                    m_map[mapY * m_mapWidth + mapX] = ' ';
-                }
-                if (m_maze[y * m_mazeWidth + x] & CELL_PATH_E)
-                {
-                    int mapY = y * (m_pathWidth + 1) + p + 1;
-                    int mapX = x * (m_pathWidth + 1) + m_pathWidth + 1;
-                    m_map[mapY * m_mapWidth + mapX] = ' ';
-                }
-            }
-        }
-    }
+bool Game::saveMap()
+{
+    PlayerStart start;
+    start.x = m_playerX;
+    start.y = m_playerY;
+    start.angle = m_playerAngle;
+    return m_map.save(m_mapFile, start) && m_lightmap.save(m_mapFile + ".light", m_map)
+        && m_textureMap.save(m_mapFile + ".tex");
+}
+
+void Game::mapChanged()
+{
+    bool resized = m_mapWidth != m_map.width() || m_mapHeight != m_map.height();
+    m_mapWidth = m_map.width();
+    m_mapHeight = m_map.height();
+    m_depth = m_mapHeight;
+    if (resized || !m_mapEditorWindow)
+        layoutMapWindows();
+    m_miniMap.invalidate();
+    m_editorMap.invalidate();
+    m_renderer.invalidateColumns();
+    m_distanceFieldValid = false;
+    updateDistanceField();
+    // the old entities could be standing in the new walls
+    m_entities.clear();
+    m_entities.scatter(m_map, m_entityCount, m_mazeSeed);
+    m_swarm.spawn(m_entities, m_map, m_agentCount, m_mazeSeed + 1);
+    m_flowField.invalidate();
+    m_mapEditor.clear();
+    m_dirty = true;
+}
+
+void Game::layoutScreen()
+{
+    // the game view takes half the terminal's width, the rest of the
+    // tables follow from the frame size on the next render
+    m_ansiOutput.resize(COLS, LINES);
+    m_screenWidth = max(1, COLS / 2);
+    m_screenHeight = max(1, min(m_screenWidth / 2, LINES));
+    m_screenStartPosY = (LINES - m_screenHeight) / 2;
+    m_screenStartPosX = (COLS - m_screenWidth) / 1.1;
+
+    if (m_gameWindow)
+        delwin(m_gameWindow);
+    m_gameWindow = newwin(m_screenHeight, m_screenWidth, m_screenStartPosY, m_screenStartPosX);
+    if (m_mapEditorWindow)
+        layoutMapWindows();
+}
+
+void Game::layoutMapWindows()
+{
+    if (m_mapEditorWindow)
+        delwin(m_mapEditorWindow);
+    // the minimap stays left of the game view, the editor can use the
+    // whole terminal, both scroll over bigger maps
+    // the bottom lines are left for the profiling HUD
+    int height = max(1, min(m_mapHeight, LINES - 4));
+    m_miniMap.resize(max(2, min(m_mapWidth * 2, m_screenStartPosX - 2)), height);
+    m_mapEditorWindow = newwin(height, max(2, min(m_mapWidth * 2, COLS - 2)), 1, 1);
+    m_editorOutput.setWindow(m_mapEditorWindow);
+    m_editorMap.resize(getmaxx(m_mapEditorWindow), getmaxy(m_mapEditorWindow));
+}
+
+void Game::lightmapBaked()
+{
+    int left, top, right, bottom;
+    m_lightmap.lastBakeArea(left, top, right, bottom);
+    m_miniMap.regionChanged(left, top, right, bottom);
+    m_editorMap.regionChanged(left, top, right, bottom);
+    m_renderer.invalidateColumns();
 }
 
 // void Game::mapRender(WINDOW *window)
@@ -507,83 +694,238 @@ void Game::editMap()
     clearScreen();
     mvprintw(0, 0, "EDIT MAP MODE (PRESS M TO SWITCH BACK TO GAME)");
     refresh();
-    mapRender(m_mapEditorWindow);
 
     m_playerAngle = PI;
-    int pixelX = 0, pixelY = 0;
+    // cursor in map cells, the editor view scrolls to keep it in sight
+    int cursorX = 0, cursorY = 0;
+    // the other corner of rectangles, lines and copies
+    int markX = 0, markY = 0;
+
+    // Bring the map's dependents up to date after an edit, undo or redo,
+    // or take it back with takeBack if it walled in the player
+    auto finishEdit = [&](bool changed, const char *what, chrono::steady_clock::time_point start,
+                          const function<void()> &takeBack)
+    {
+        if (changed && m_map.inBounds((int)m_playerX, (int)m_playerY) && m_map.isWall((int)m_playerX, (int)m_playerY))
+        {
+            takeBack();
+            mvprintw(0, 48, "NOT ALLOWED, IT WOULD WALL IN THE PLAYER");
+        }
+        else if (changed)
+        {
+            const MapEditor::Edit &edit = m_mapEditor.lastChange();
+            mapEdited(edit);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            mvprintw(0, 48, "%s %ld CELLS IN %.1f MS (UNDO %zu, REDO %zu)", what, edit.cells, ms,
+                     m_mapEditor.undoCount(), m_mapEditor.redoCount());
+        }
+        else
+        {
+            mvprintw(0, 48, "NOTHING CHANGED");
+        }
+        clrtoeol();
+        refresh();
+    };
+    auto revert = [&] { m_mapEditor.revert(m_map); };
+    mapRender(m_editorOutput, m_editorMap, 0, 0, cursorX, cursorY);
     while (m_mapEditorMode)
     {
+        int frameX, frameY;
+        if (m_editorMap.toFrame(cursorX, cursorY, frameX, frameY))
+            wmove(m_mapEditorWindow, frameY, frameX);
+        wrefresh(m_mapEditorWindow);
+
+        // while a maze is generated wake up to show the rows that arrived
+        wtimeout(m_mapEditorWindow, m_mazeStreamer.active() ? 30 : -1);
         int ch = wgetch(m_mapEditorWindow);
+        if (m_mazeStreamer.active())
+        {
+            streamMaze();
+            if (m_mazeStreamer.active())
+                mvprintw(0, 48, "GENERATING %d%% (G CANCELS)", (int)(m_mazeStreamer.progress() * 100));
+            else
+                mvprintw(0, 48, "GENERATED %dx%d MAZE", m_mazeWidth, m_mazeHeight);
+            clrtoeol();
+            refresh();
+            // the rows still to come would overwrite edits, and saving or
+            // loading would catch the maze half done
+            if (m_mazeStreamer.active() && ch > 0 && ch < 128 && strchr("12bBnNlLfFxXuUzZcCoOpPiItT", ch))
+                ch = ERR;
+        }
         switch (ch)
         {
         case 'a': case 'A': 
-            if (pixelX > 0)     
-                wmove(m_mapEditorWindow, pixelY, pixelX-=2);
+            if (cursorX > 0)     
+                cursorX--;
             break;
         case 'd': case 'D':
-            if (pixelX < m_mapWidth * 2)             
-                wmove(m_mapEditorWindow, pixelY, pixelX+=2);
+            if (cursorX < m_mapWidth - 1)             
+                cursorX++;
             break;
         case 'w': case 'W':
-            if (pixelY > 0)             
-                wmove(m_mapEditorWindow, pixelY--, pixelX);
+            if (cursorY > 0)             
+                cursorY--;
             break;
         case 's': case 'S':
-            if (pixelY < m_mapHeight)    
-                wmove(m_mapEditorWindow, pixelY++, pixelX);
+            if (cursorY < m_mapHeight - 1)    
+                cursorY++;
             break;
         case 'g': case 'G':
-            generateMaze();
-            mapRender(m_mapEditorWindow);
+            if (m_mazeStreamer.active())
+            {
+                // keep what was carved so far, the rest stays wall
+                m_mazeStreamer.cancel();
+                mapChanged();
+                mvprintw(0, 48, "CANCELLED");
+                clrtoeol();
+                refresh();
+            }
+            else
+            {
+                generateMaze();
+            }
+            break;
+        case 'p': case 'P':
+            mvprintw(0, 48, saveMap() ? "SAVED %s" : "COULD NOT SAVE %s", m_mapFile.c_str());
+            clrtoeol();
+            refresh();
+            break;
+        case 'o': case 'O':
+            if (loadMap())
+            {
+                cursorX = cursorY = 0;
+                clearScreen();
+                mvprintw(0, 0, "EDIT MAP MODE (PRESS M TO SWITCH BACK TO GAME)");
+                mvprintw(0, 48, "LOADED %s", m_mapFile.c_str());
+            }
+            else
+            {
+                mvprintw(0, 48, "COULD NOT LOAD %s", m_mapFile.c_str());
+            }
+            clrtoeol();
+            refresh();
             break;
         case 'c': case 'C':
             for (int x = 0; x < m_mapWidth; x++) 
             {
                 for (int y = 0; y < m_mapHeight; y++)
                 {
-                    if (x == 0 || x == m_mapWidth - 1 || y == 0 || y == m_mapHeight - 1)
-                        m_map[y * m_mapWidth + x] = '#';
-                    else 
-                        m_map[y * m_mapWidth + x] = ' ';
+                    bool isBorder = x == 0 || x == m_mapWidth - 1 || y == 0 || y == m_mapHeight - 1;
+                    m_map.setWall(x, y, isBorder);
                 }    
             }
-            mapRender(m_mapEditorWindow);
+            m_miniMap.invalidate();
+            m_editorMap.invalidate();
+            m_renderer.invalidateColumns();
+            m_distanceFieldValid = false;
+            updateDistanceField();
+            m_flowField.invalidate();
+            m_lightmap.bake(m_map, &m_threadPool);
+            // the history does not know about the cleared cells
+            m_mapEditor.clear();
             break;
         case '1':
+        case '2': 
         {
-            int idx = pixelY * m_mapWidth + pixelX / 2;
-            int playerIdx = (int)m_playerY * m_mapWidth + (int)m_playerX;
-            if (idx != playerIdx) 
-            {
-                wattron(m_mapEditorWindow, COLOR_PAIR(1));
-                mvwaddstr(m_mapEditorWindow, pixelY, pixelX, "  ");
-                wattroff(m_mapEditorWindow, COLOR_PAIR(1));
-                m_map[idx] = '#';
-            }
+            auto start = chrono::steady_clock::now();
+            finishEdit(m_mapEditor.fillRect(m_map, cursorX, cursorY, cursorX, cursorY, ch == '1'),
+                       ch == '1' ? "WALLED" : "CLEARED", start, revert);
             break;
         }  
-        case '2': 
+        case 'v': case 'V':
+            markX = cursorX;
+            markY = cursorY;
+            mvprintw(0, 48, "MARK %d,%d", markX, markY);
+            clrtoeol();
+            refresh();
+            break;
+        case 'b': case 'B':
+        case 'n': case 'N':
+        {
+            bool wall = ch == 'b' || ch == 'B';
+            auto start = chrono::steady_clock::now();
+            finishEdit(m_mapEditor.fillRect(m_map, markX, markY, cursorX, cursorY, wall),
+                       wall ? "WALLED" : "CLEARED", start, revert);
+            break;
+        }
+        case 'l': case 'L':
+        {
+            auto start = chrono::steady_clock::now();
+            finishEdit(m_mapEditor.drawLine(m_map, markX, markY, cursorX, cursorY, true), "WALLED", start, revert);
+            break;
+        }
+        case 'f': case 'F':
         {
-            int idx = pixelY * m_mapWidth + pixelX / 2;
-            int playerIdx = (int)m_playerY * m_mapWidth + (int)m_playerX;
-            if (idx != playerIdx) 
+            auto start = chrono::steady_clock::now();
+            finishEdit(m_mapEditor.floodFill(m_map, cursorX, cursorY), "FILLED", start, revert);
+            break;
+        }
+        case 'y': case 'Y':
+            m_mapEditor.copy(m_map, markX, markY, cursorX, cursorY);
+            mvprintw(0, 48, "COPIED %dx%d", abs(cursorX - markX) + 1, abs(cursorY - markY) + 1);
+            clrtoeol();
+            refresh();
+            break;
+        case 'x': case 'X':
+        {
+            auto start = chrono::steady_clock::now();
+            finishEdit(m_mapEditor.hasClipboard() && m_mapEditor.paste(m_map, cursorX, cursorY), "PASTED", start,
+                       revert);
+            break;
+        }
+        case 'u': case 'U':
+        {
+            auto start = chrono::steady_clock::now();
+            finishEdit(m_mapEditor.undo(m_map), "UNDID", start, [&] { m_mapEditor.redo(m_map); });
+            break;
+        }
+        case 'z': case 'Z':
+        {
+            auto start = chrono::steady_clock::now();
+            finishEdit(m_mapEditor.redo(m_map), "REDID", start, [&] { m_mapEditor.undo(m_map); });
+            break;
+        }
+        case 'i': case 'I':
+        {
+            bool had = m_lightmap.hasLight(cursorX, cursorY);
+            if (m_lightmap.toggleLight(m_map, cursorX, cursorY, &m_threadPool))
+            {
+                lightmapBaked();
+                mvprintw(0, 48, "%s LIGHT, BAKED %d BLOCKS IN %.1f MS (%zu LIGHTS)", had ? "REMOVED" : "ADDED",
+                         m_lightmap.lastBakeBlocks(), m_lightmap.lastBakeSeconds() * 1000, m_lightmap.lights().size());
+            }
+            else
             {
-                mvwaddstr(m_mapEditorWindow, pixelY, pixelX, "  ");
-                m_map[idx] = ' ';
+                mvprintw(0, 48, "LIGHTS GO ON FLOOR CELLS");
             }
+            clrtoeol();
+            refresh();
+            break;
+        }
+        case 't': case 'T':
+        {
+            // the next texture after the one under the cursor, on the
+            // rectangle from the mark
+            int texture = (m_textureMap.at(cursorX, cursorY) + 1) % TextureAtlas::TextureCount;
+            long cells = m_textureMap.fill(min(markX, cursorX), min(markY, cursorY), max(markX, cursorX) + 1,
+                                           max(markY, cursorY) + 1, texture);
+            m_renderer.invalidateColumns();
+            mvprintw(0, 48, "TEXTURE %s ON %ld CELLS", TextureAtlas::textureName(texture), cells);
+            clrtoeol();
+            refresh();
+            break;
+        }
+        case KEY_RESIZE:
+            layoutScreen();
+            clearScreen();
+            mvprintw(0, 0, "EDIT MAP MODE (PRESS M TO SWITCH BACK TO GAME)");
+            refresh();
             break;
-        }  
         case '3':
         {
-            int updatedIdx = pixelY * m_mapWidth + pixelX / 2;
-            if (m_map[updatedIdx] != '#') {
-                wattron(m_mapEditorWindow, COLOR_PAIR(2));
-                mvwaddstr(m_mapEditorWindow, pixelY, pixelX, "  ");
-                wattroff(m_mapEditorWindow, COLOR_PAIR(2));
-
-                mvwaddstr(m_mapEditorWindow, m_playerY, m_playerX * 2, "  ");
-                m_playerX = pixelX / 2;
-                m_playerY = pixelY;
+            if (m_map.inBounds(cursorX, cursorY) && !m_map.isWall(cursorX, cursorY)) {
+                m_playerX = cursorX;
+                m_playerY = cursorY;
             }
             break;
         }
@@ -593,20 +935,21 @@ void Game::editMap()
         default:
             break;
         }
-        wmove(m_mapEditorWindow, pixelY, pixelX);
-        wrefresh(m_mapEditorWindow);
+        mapRender(m_editorOutput, m_editorMap, 0, 0, cursorX, cursorY);
     }
     clearScreen();
 }
 
 void Game::clearScreen()
 {
+    m_frame.invalidate();
+    m_miniMap.invalidate();
+    m_editorMap.invalidate();
+    m_ansiOutput.invalidate();
     clear();
-    wclear(m_miniMapWindow);
     wclear(m_gameWindow);
     wclear(m_mapEditorWindow);
     refresh();
     wrefresh(m_gameWindow);
-    wrefresh(m_miniMapWindow);
     wrefresh(m_mapEditorWindow);
 }
\ No newline at end of file
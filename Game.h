@@ -3,35 +3,91 @@
 #include <string>
 #include <chrono>
 
-#include <stack>
 #include <vector>
-#include <utility>
+
+#include "DistanceField.h"
+#include "EntityLayer.h"
+#include "FlowField.h"
+#include "FrameBuffer.h"
+#include "Lightmap.h"
+#include "TextureAtlas.h"
+#include "TextureMap.h"
+#include "MapEditor.h"
+#include "MazeGenerator.h"
+#include "MazeStreamer.h"
+#include "MiniMap.h"
+#include "Profiler.h"
+#include "QualityGovernor.h"
+#include "AnsiOutput.h"
+#include "NcursesOutput.h"
+#include "Renderer.h"
+#include "Swarm.h"
+#include "ThreadPool.h"
+#include "WallMap.h"
 
 #define PI 3.14159265f
 
+// Settings given on the command line
+struct GameOptions
+{
+    int threads = 0;        // render threads, 0 uses every core
+    float targetFps = 60;   // render rate cap, 0 renders as often as possible
+    bool idle = true;       // skip rendering while nothing changes
+    std::string mapFile;    // map to start on and to save to
+    unsigned seed = 0;      // first maze seed, 0 picks one from the clock
+    int mazeWidth = 10;     // maze cells of generated mazes
+    int mazeHeight = 10;
+    MazeGenerator::Algorithm generator = MazeGenerator::Backtracker;
+    bool ansiOutput = false;    // write escape sequences instead of going through ncurses
+    std::string traceFile;      // profile every frame to this file, .json or .csv
+    int entities = 0;           // entities scattered over every new map
+    int agents = 0;             // agents chasing the player on every new map
+    float renderBudget = 10;    // milliseconds a frame may take to render, 0 for full quality always
+};
+
 class Game
 {
 public:
-    Game();
+    Game(const GameOptions &options = GameOptions());
     ~Game();
     void run();
 
 private:
-    void gameControl(float elapsedTime);
+    void gameControl(int timeoutMs);
+    void handleKey(int ch);
+    void simulate(float elapsedTime, std::chrono::steady_clock::time_point now);
+    bool isMoving(std::chrono::steady_clock::time_point now) const;
     void gameRender();
-    void mapRender(WINDOW *window);
+    void hudRender();
+    void mapRender(OutputBackend &output, MiniMap &miniMap, int left, int top, int focusX, int focusY);
+    void cellEdited(int x, int y);
+    // bring everything that depends on the map up to date after a bulk edit
+    void mapEdited(const MapEditor::Edit &edit);
     void clearScreen();
     void editMap();
+    // start generating a maze in the background, it streams into the map
     void generateMaze();
+    // apply what the maze generator handed over, false if nothing changed
+    bool streamMaze();
+    bool loadMap();
+    bool saveMap();
+    void mapChanged();
+    // size the game view and the windows to the terminal
+    void layoutScreen();
+    void layoutMapWindows();
+    // the lightmap was baked again, repaint what it covered
+    void lightmapBaked();
+    // build the distance field if the raycaster needs it and it is out of date
+    void updateDistanceField();
 
 private:
     float m_playerX = 1.0f;
     float m_playerY= 1.0f;
     float m_playerAngle = PI / 2.0f;
-    float m_playerMoveSpeed = 150.0f;
-    float m_playerRotateSpeed = 70.0f;
-    int m_mapHeight;
-    int m_mapWidth;
+    float m_playerMoveSpeed = 5.0f;         // cells per second
+    float m_playerRotateSpeed = 2.0f;       // radians per second
+    int m_mapHeight = 0;
+    int m_mapWidth = 0;
     float m_depth;
     int m_mazeHeight = 10;
     int m_mazeWidth = 10;
@@ -40,25 +96,61 @@ private:
     int m_screenHeight;
     int m_screenStartPosY;
     int m_screenStartPosX;
-    WINDOW *m_gameWindow;
-    WINDOW *m_miniMapWindow;
-    WINDOW *m_mapEditorWindow;
-    std::string m_map;
+    WINDOW *m_gameWindow = nullptr;
+    WINDOW *m_mapEditorWindow = nullptr;
+    MiniMap m_miniMap;
+    MiniMap m_editorMap;
+    ThreadPool m_threadPool;
+    Renderer m_renderer;
+    FrameBuffer m_frame;
+    NcursesOutput m_ncursesOutput;
+    AnsiOutput m_ansiOutput;
+    OutputBackend *m_output;                // where game frames go, one of the two above
+    NcursesOutput m_editorOutput;
+    std::string m_status;                   // status line as last sent
+    Profiler m_profiler;
+    QualityGovernor m_governor;             // lowers the render quality to stay in the budget
+    WallMap m_map;
+    DistanceField m_distanceField;
+    bool m_distanceFieldValid = false;      // built for the current map
+    Lightmap m_lightmap;                    // lights placed in the editor, saved next to the map
+    TextureAtlas m_textureAtlas;
+    TextureMap m_textureMap;                // wall textures painted in the editor, saved next to the map
+    bool m_textured = true;                 // walls drawn with their textures, or flat
+    std::string m_mapFile;
     bool m_running = true;
     bool m_mapEditorMode = false;
+    bool m_sendChangedCellsOnly = true;
 
-    // int m_mazeWidth;
-    // int m_mazeHeight;
-    std::vector<int> m_maze;
-    enum 
+    // main loop timing
+    float m_tickRate = 60.0f;               // simulation ticks per second
+    float m_targetFps;
+    bool m_idleWhenUnchanged;
+    int m_maxTicksPerFrame = 5;
+    float m_keyHoldTime = 0.1f;             // seconds a key press keeps its action going
+    bool m_dirty = true;                    // something changed since the last frame
+    float m_frameTime = 0.0f;
+    enum Action
     {
-        CELL_PATH_N = 0x01,
-        CELL_PATH_E = 0X02,
-        CELL_PATH_S = 0X04,
-        CELL_PATH_W = 0X08,
-        CELL_VISITED = 0X10
+        ACTION_TURN_LEFT,
+        ACTION_TURN_RIGHT,
+        ACTION_FORWARD,
+        ACTION_BACKWARD,
+        ACTION_COUNT
     };
-    int m_nVisitedCells;
-    std::stack<std::pair<int, int>> m_stack;
+    std::chrono::steady_clock::time_point m_heldUntil[ACTION_COUNT] = {};
+
+    MapEditor m_mapEditor;                  // bulk edits and their undo history
+    int m_smallEdit = 256;                  // cells past which an edit is handled as a region
+
+    MazeStreamer m_mazeStreamer;
+    MazeGenerator::Algorithm m_mazeAlgorithm;
+    unsigned m_mazeSeed;        // seed of the next maze, counts up
     int m_pathWidth = 2;
+    EntityLayer m_entities;
+    int m_entityCount;          // entities scattered over every new map
+    FlowField m_flowField;      // towards the player, for the agents
+    Swarm m_swarm;
+    int m_agentCount;           // agents put on every new map
+    int m_flowBudget = 1 << 16; // flow field cells searched per tick
 };
\ No newline at end of file
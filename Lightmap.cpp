@@ -0,0 +1,418 @@
+#include "Lightmap.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// File layout: LightFileHeader, lightCount LightRecords, then blockCount
+// times a uint32_t block index followed by the block's values
+static const char LightMagic[8] = { 'F', 'P', 'S', 'L', 'I', 'T', '1', 0 };
+static const uint32_t LightVersion = 1;
+
+struct LightFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    uint32_t lightCount;
+    uint32_t blockCount;
+    uint32_t reserved;
+    uint64_t key;
+};
+
+struct LightRecord
+{
+    int32_t x;
+    int32_t y;
+    float radius;
+    float intensity;
+};
+
+// how far outside a wall face its light is measured, so the ray from the
+// light stops short of the wall
+static const float FaceOffset = 0.01f;
+
+void Lightmap::clear()
+{
+    m_lights.clear();
+    m_lightCells.clear();
+    m_blocks.clear();
+    m_queue.clear();
+    m_queueSlot.clear();
+    m_width = m_height = 0;
+    m_blocksPerRow = m_blocksPerColumn = 0;
+}
+
+void Lightmap::setLights(const vector<Light> &lights)
+{
+    m_lights = lights;
+    m_lightCells.clear();
+    for (const Light &light : m_lights)
+        m_lightCells.insert(cellKey(light.x, light.y));
+}
+
+void Lightmap::fit(const WallMap &map)
+{
+    if (map.width() == m_width && map.height() == m_height)
+        return;
+    m_width = map.width();
+    m_height = map.height();
+    m_blocksPerRow = (m_width + BlockSize - 1) >> BlockShift;
+    m_blocksPerColumn = (m_height + BlockSize - 1) >> BlockShift;
+    m_blocks.clear();
+    m_blocks.resize((size_t)m_blocksPerRow * m_blocksPerColumn);
+    m_queue.clear();
+    m_queueSlot.assign(m_blocks.size(), -1);
+}
+
+bool Lightmap::toggleLight(const WallMap &map, int x, int y, ThreadPool *pool)
+{
+    Light light;
+    light.x = x;
+    light.y = y;
+    auto found = find_if(m_lights.begin(), m_lights.end(),
+                         [&](const Light &other) { return other.x == x && other.y == y; });
+    if (found != m_lights.end())
+    {
+        light = *found;
+        m_lights.erase(found);
+        m_lightCells.erase(cellKey(x, y));
+    }
+    else if (map.inBounds(x, y) && !map.isWall(x, y))
+    {
+        m_lights.push_back(light);
+        m_lightCells.insert(cellKey(x, y));
+    }
+    else
+    {
+        return false;
+    }
+    if (map.width() != m_width || map.height() != m_height)
+    {
+        bake(map, pool);
+        return true;
+    }
+    int left, top, right, bottom;
+    lightArea(light, left, top, right, bottom);
+    queueArea(left, top, right, bottom);
+    bakeQueued(map, pool);
+    return true;
+}
+
+void Lightmap::bake(const WallMap &map, ThreadPool *pool)
+{
+    fit(map);
+    for (auto &block : m_blocks)
+        block.reset();
+    for (const Light &light : m_lights)
+    {
+        int left, top, right, bottom;
+        lightArea(light, left, top, right, bottom);
+        queueArea(left, top, right, bottom);
+    }
+    bakeQueued(map, pool);
+}
+
+void Lightmap::wallsChanged(const WallMap &map, int left, int top, int right, int bottom, ThreadPool *pool)
+{
+    if (m_lights.empty())
+        return;
+    if (map.width() != m_width || map.height() != m_height)
+    {
+        bake(map, pool);
+        return;
+    }
+    // a changed cell also changes the faces of its neighbours
+    left--, top--, right++, bottom++;
+    for (const Light &light : m_lights)
+    {
+        int lightLeft, lightTop, lightRight, lightBottom;
+        lightArea(light, lightLeft, lightTop, lightRight, lightBottom);
+        if (lightLeft < right && left < lightRight && lightTop < bottom && top < lightBottom)
+            queueArea(lightLeft, lightTop, lightRight, lightBottom);
+    }
+    bakeQueued(map, pool);
+}
+
+void Lightmap::lightArea(const Light &light, int &left, int &top, int &right, int &bottom) const
+{
+    // a face can be up to a cell further away than the cell it belongs to
+    int reach = (int)ceil(light.radius) + 1;
+    left = light.x - reach;
+    top = light.y - reach;
+    right = light.x + reach + 1;
+    bottom = light.y + reach + 1;
+}
+
+void Lightmap::queueArea(int left, int top, int right, int bottom)
+{
+    left = max(left, 0);
+    top = max(top, 0);
+    right = min(right, m_width);
+    bottom = min(bottom, m_height);
+    if (left >= right || top >= bottom)
+        return;
+    for (int blockY = top >> BlockShift; blockY <= (bottom - 1) >> BlockShift; blockY++)
+        for (int blockX = left >> BlockShift; blockX <= (right - 1) >> BlockShift; blockX++)
+        {
+            int index = blockY * m_blocksPerRow + blockX;
+            if (m_queueSlot[index] >= 0)
+                continue;
+            m_queueSlot[index] = m_queue.size();
+            m_queue.push_back(index);
+        }
+}
+
+void Lightmap::bakeQueued(const WallMap &map, ThreadPool *pool)
+{
+    auto start = chrono::steady_clock::now();
+
+    // the lights that reach each queued block
+    vector<vector<int>> blockLights(m_queue.size());
+    for (size_t i = 0; i < m_lights.size(); i++)
+    {
+        const Light &light = m_lights[i];
+        if (!map.inBounds(light.x, light.y) || map.isWall(light.x, light.y))
+            continue;
+        int left, top, right, bottom;
+        lightArea(light, left, top, right, bottom);
+        left = max(left, 0);
+        top = max(top, 0);
+        right = min(right, m_width);
+        bottom = min(bottom, m_height);
+        for (int blockY = top >> BlockShift; blockY <= (bottom - 1) >> BlockShift; blockY++)
+            for (int blockX = left >> BlockShift; blockX <= (right - 1) >> BlockShift; blockX++)
+            {
+                int slot = m_queueSlot[blockY * m_blocksPerRow + blockX];
+                if (slot >= 0)
+                    blockLights[slot].push_back(i);
+            }
+    }
+
+    // blocks no light reaches any more are dropped, they read as Ambient
+    m_bakeLeft = m_bakeTop = INT_MAX;
+    m_bakeRight = m_bakeBottom = 0;
+    for (size_t slot = 0; slot < m_queue.size(); slot++)
+    {
+        int index = m_queue[slot];
+        m_queueSlot[index] = -1;
+        if (blockLights[slot].empty())
+            m_blocks[index].reset();
+        else if (!m_blocks[index])
+            m_blocks[index].reset(new Block);
+        int x = (index % m_blocksPerRow) << BlockShift, y = (index / m_blocksPerRow) << BlockShift;
+        m_bakeLeft = min(m_bakeLeft, x);
+        m_bakeTop = min(m_bakeTop, y);
+        m_bakeRight = max(m_bakeRight, min(x + BlockSize, m_width));
+        m_bakeBottom = max(m_bakeBottom, min(y + BlockSize, m_height));
+    }
+
+    // each block only writes its own values
+    auto body = [&](int begin, int end)
+    {
+        for (int slot = begin; slot < end; slot++)
+            if (!blockLights[slot].empty())
+                bakeBlock(map, m_queue[slot], blockLights[slot], *m_blocks[m_queue[slot]]);
+    };
+    if (pool)
+        pool->parallelFor(0, m_queue.size(), 1, body);
+    else
+        body(0, m_queue.size());
+
+    m_bakedBlocks = m_queue.size();
+    m_queue.clear();
+    m_bakeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void Lightmap::bakeBlock(const WallMap &map, int blockIndex, const vector<int> &lights, Block &block) const
+{
+    auto toValue = [](float light) { return (uint8_t)min(255.0f, Ambient + (255 - Ambient) * light); };
+    // North, East, South, West: the neighbour on that side and the face normal
+    static const int faceX[4] = { 0, 1, 0, -1 };
+    static const int faceY[4] = { -1, 0, 1, 0 };
+
+    int left = (blockIndex % m_blocksPerRow) << BlockShift;
+    int top = (blockIndex / m_blocksPerRow) << BlockShift;
+    int right = min(left + BlockSize, m_width);
+    int bottom = min(top + BlockSize, m_height);
+    memset(&block, Ambient, sizeof(block));
+    for (int y = top; y < bottom; y++)
+        for (int x = left; x < right; x++)
+        {
+            int i = cellIndex(x, y);
+            if (!map.isWall(x, y))
+            {
+                block.cell[i] = toValue(lightAt(map, x + 0.5f, y + 0.5f, 0, 0, lights));
+                continue;
+            }
+            // only the faces open to a floor cell can be seen
+            for (int face = 0; face < 4; face++)
+            {
+                int nextX = x + faceX[face], nextY = y + faceY[face];
+                if (!map.inBounds(nextX, nextY) || map.isWall(nextX, nextY))
+                    continue;
+                float px = x + 0.5f + faceX[face] * (0.5f + FaceOffset);
+                float py = y + 0.5f + faceY[face] * (0.5f + FaceOffset);
+                block.face[i][face] = toValue(lightAt(map, px, py, faceX[face], faceY[face], lights));
+            }
+        }
+}
+
+float Lightmap::lightAt(const WallMap &map, float px, float py, float normalX, float normalY,
+                        const vector<int> &lights) const
+{
+    float total = 0;
+    for (int i : lights)
+    {
+        const Light &light = m_lights[i];
+        float dx = light.x + 0.5f - px, dy = light.y + 0.5f - py;
+        float distanceSq = dx * dx + dy * dy;
+        if (distanceSq >= light.radius * light.radius)
+            continue;
+        float distance = sqrt(distanceSq);
+        float facing = 1.0f;
+        if (distance > 0.0f)
+        {
+            if (normalX != 0 || normalY != 0)
+                facing = (dx * normalX + dy * normalY) / distance;
+            if (facing <= 0.0f)
+                continue;
+            // line of sight: trace from the light, anything hit on the way is in front
+            RayHit hit = m_raycaster.cast(map, light.x + 0.5f, light.y + 0.5f, -dx / distance, -dy / distance, distance);
+            if (hit.hit && hit.distance < distance)
+                continue;
+        }
+        float fade = 1.0f - distance / light.radius;
+        total += light.intensity * fade * fade * facing;
+    }
+    return total;
+}
+
+void Lightmap::lastBakeArea(int &left, int &top, int &right, int &bottom) const
+{
+    left = m_bakeLeft;
+    top = m_bakeTop;
+    right = m_bakeRight;
+    bottom = m_bakeBottom;
+    if (left >= right || top >= bottom)
+        left = top = right = bottom = 0;
+}
+
+uint64_t Lightmap::key(const WallMap &map) const
+{
+    auto mix = [](uint64_t hash, uint64_t value)
+    {
+        hash ^= value;
+        hash *= 0x9e3779b97f4a7c15ULL;
+        return hash ^ (hash >> 29);
+    };
+    uint64_t hash = mix(map.hash(), ((uint64_t)LightVersion << 32) | ((uint64_t)BlockShift << 8) | Ambient);
+    for (const Light &light : m_lights)
+    {
+        uint32_t radius, intensity;
+        memcpy(&radius, &light.radius, sizeof(radius));
+        memcpy(&intensity, &light.intensity, sizeof(intensity));
+        hash = mix(hash, ((uint64_t)(uint32_t)light.x << 32) | (uint32_t)light.y);
+        hash = mix(hash, ((uint64_t)radius << 32) | intensity);
+    }
+    return hash;
+}
+
+bool Lightmap::save(const string &fileName, const WallMap &map) const
+{
+    LightFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LightMagic, sizeof(LightMagic));
+    header.version = LightVersion;
+    header.width = map.width();
+    header.height = map.height();
+    header.lightCount = m_lights.size();
+    // blocks baked for another map are left out, the next load bakes them
+    bool baked = map.width() == m_width && map.height() == m_height;
+    for (const auto &block : m_blocks)
+        header.blockCount += baked && block;
+    header.key = key(map);
+
+    string tempName = fileName + ".tmp";
+    FILE *file = fopen(tempName.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (const Light &light : m_lights)
+    {
+        LightRecord record = { light.x, light.y, light.radius, light.intensity };
+        ok = ok && fwrite(&record, sizeof(record), 1, file) == 1;
+    }
+    for (size_t i = 0; ok && baked && i < m_blocks.size(); i++)
+    {
+        if (!m_blocks[i])
+            continue;
+        uint32_t index = i;
+        ok = fwrite(&index, sizeof(index), 1, file) == 1 && fwrite(m_blocks[i].get(), sizeof(Block), 1, file) == 1;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tempName.c_str(), fileName.c_str()) != 0)
+    {
+        remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Lightmap::load(const string &fileName, const WallMap &map, ThreadPool *pool, bool &fromCache)
+{
+    fromCache = false;
+    clear();
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (!file)
+        return false;
+    LightFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, LightMagic, sizeof(LightMagic)) == 0
+        && header.version == LightVersion;
+    vector<Light> lights;
+    for (uint32_t i = 0; ok && i < header.lightCount; i++)
+    {
+        // the bake area is sized from the position and radius, so like the
+        // map sides they have to be real and in range
+        LightRecord record;
+        ok = fread(&record, sizeof(record), 1, file) == 1
+            && map.inBounds(record.x, record.y)
+            && isfinite(record.radius) && record.radius > 0 && record.radius <= WallMap::MaxSide
+            && isfinite(record.intensity) && record.intensity >= 0;
+        Light light;
+        light.x = record.x;
+        light.y = record.y;
+        light.radius = record.radius;
+        light.intensity = record.intensity;
+        lights.push_back(light);
+    }
+    if (!ok)
+    {
+        fclose(file);
+        return false;
+    }
+    setLights(lights);
+
+    // the baked values are only any good for the map and lights they were baked for
+    fit(map);
+    fromCache = header.key == key(map);
+    for (uint32_t i = 0; fromCache && i < header.blockCount; i++)
+    {
+        uint32_t index;
+        unique_ptr<Block> block(new Block);
+        fromCache = fread(&index, sizeof(index), 1, file) == 1 && index < m_blocks.size()
+            && fread(block.get(), sizeof(Block), 1, file) == 1;
+        if (fromCache)
+            m_blocks[index] = move(block);
+    }
+    fclose(file);
+    if (!fromCache)
+        bake(map, pool);
+    return true;
+}
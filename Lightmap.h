@@ -0,0 +1,140 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "Raycaster.h"
+#include "ThreadPool.h"
+#include "WallMap.h"
+
+// A point light in the middle of a floor cell
+struct Light
+{
+    int x = 0;
+    int y = 0;
+    float radius = 10.0f;       // cells, nothing is lit further away
+    float intensity = 1.0f;     // light right next to it, 1 is full brightness
+};
+
+// Light baked from the point lights into every floor cell and every wall
+// face, so the renderer only looks it up.
+//
+// A cell or face is lit by each light it can see within the light's
+// radius, fading with the square of the distance, and wall faces by the
+// angle the light hits them at. Values go from 0 (black) to 255, cells no
+// light reaches get Ambient.
+//
+// The values are kept in blocks of 16x16 cells, a block only exists where
+// a light reaches, so a big map with a few lights costs little. Baking
+// splits the blocks across a thread pool. After an edit only the blocks
+// reached by the lights whose radius covers the edit are baked again,
+// nothing else can have changed.
+//
+// On disk the lights are stored together with the baked blocks and the
+// key() of the map and lights they were baked for, so the bake is only
+// redone when the map changed behind the file's back.
+class Lightmap
+{
+public:
+    static const int BlockShift = 4;            // 16x16 cells per block
+    static const int BlockSize = 1 << BlockShift;
+    static const uint8_t Ambient = 60;
+
+    const std::vector<Light> &lights() const { return m_lights; }
+    bool empty() const { return m_lights.empty(); }
+    // forget the lights and the baked values
+    void clear();
+    // replace the lights, bake() them afterwards
+    void setLights(const std::vector<Light> &lights);
+
+    // Take away the light at x, y, or add one if there is none, and bake
+    // the area it reaches. Returns false if there is no light to take away
+    // and x, y is not a floor cell.
+    bool toggleLight(const WallMap &map, int x, int y, ThreadPool *pool);
+    bool hasLight(int x, int y) const { return m_lightCells.count(cellKey(x, y)) > 0; }
+
+    // bake every block a light reaches
+    void bake(const WallMap &map, ThreadPool *pool);
+    // Cells [left, right) x [top, bottom) of the map were edited, bake
+    // again what that can have changed
+    void wallsChanged(const WallMap &map, int left, int top, int right, int bottom, ThreadPool *pool);
+
+    // light of floor cell x, y, and of a face of wall cell x, y
+    uint8_t cellLight(int x, int y) const
+    {
+        const Block *block = blockAt(x, y);
+        return block ? block->cell[cellIndex(x, y)] : (uint8_t)Ambient;
+    }
+    uint8_t faceLight(int x, int y, WallFace face) const
+    {
+        const Block *block = blockAt(x, y);
+        return block && face != WallFace::None ? block->face[cellIndex(x, y)][(int)face - 1] : (uint8_t)Ambient;
+    }
+
+    // What the last bake did: the map cells it covered, right and bottom
+    // excluded, the blocks baked and how long it took
+    void lastBakeArea(int &left, int &top, int &right, int &bottom) const;
+    int lastBakeBlocks() const { return m_bakedBlocks; }
+    double lastBakeSeconds() const { return m_bakeSeconds; }
+
+    // hash of the map and the lights, what the baked values depend on
+    uint64_t key(const WallMap &map) const;
+
+    // Write the lights and the baked values to fileName, replacing it
+    // atomically. Returns false and leaves the file alone on failure.
+    bool save(const std::string &fileName, const WallMap &map) const;
+    // Read the lights from fileName and the baked values too if they were
+    // baked for this map, otherwise bake them again. Returns false, and
+    // clears the lights, if there is no light file for the map or a light
+    // in it is off the map or has a radius or intensity out of range.
+    // fromCache tells whether the bake was skipped.
+    bool load(const std::string &fileName, const WallMap &map, ThreadPool *pool, bool &fromCache);
+
+private:
+    struct Block
+    {
+        uint8_t cell[BlockSize * BlockSize];
+        uint8_t face[BlockSize * BlockSize][4];     // North, East, South, West
+    };
+
+    const Block *blockAt(int x, int y) const
+    {
+        if (m_blocks.empty() || (unsigned)x >= (unsigned)m_width || (unsigned)y >= (unsigned)m_height)
+            return nullptr;
+        return m_blocks[(y >> BlockShift) * m_blocksPerRow + (x >> BlockShift)].get();
+    }
+    static uint64_t cellKey(int x, int y) { return ((uint64_t)(uint32_t)y << 32) | (uint32_t)x; }
+    static int cellIndex(int x, int y) { return ((y & (BlockSize - 1)) << BlockShift) | (x & (BlockSize - 1)); }
+
+    // size the block table for map, dropping the blocks if it changed
+    void fit(const WallMap &map);
+    // cells light can reach, right and bottom excluded
+    void lightArea(const Light &light, int &left, int &top, int &right, int &bottom) const;
+    // add the blocks over cells [left, right) x [top, bottom) to the ones
+    // the next bakeQueued() bakes
+    void queueArea(int left, int top, int right, int bottom);
+    void bakeQueued(const WallMap &map, ThreadPool *pool);
+    void bakeBlock(const WallMap &map, int blockIndex, const std::vector<int> &lights, Block &block) const;
+    // light reaching point px, py from the lights, facing normalX, normalY
+    // (0, 0 for a floor cell, which is lit from every side)
+    float lightAt(const WallMap &map, float px, float py, float normalX, float normalY,
+                  const std::vector<int> &lights) const;
+
+private:
+    std::vector<Light> m_lights;
+    std::unordered_set<uint64_t> m_lightCells;     // cellKey() of each light
+    int m_width = 0;
+    int m_height = 0;
+    int m_blocksPerRow = 0;
+    int m_blocksPerColumn = 0;
+    std::vector<std::unique_ptr<Block>> m_blocks;   // null for blocks no light reaches
+    std::vector<int> m_queue;                       // blocks to bake
+    std::vector<int> m_queueSlot;                   // each block's place in m_queue, -1 if not queued
+    Raycaster m_raycaster;                          // line of sight, DDA
+
+    int m_bakeLeft = 0, m_bakeTop = 0, m_bakeRight = 0, m_bakeBottom = 0;
+    int m_bakedBlocks = 0;
+    double m_bakeSeconds = 0;
+};
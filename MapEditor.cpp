@@ -0,0 +1,239 @@
+#include "MapEditor.h"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+void MapEditor::clear()
+{
+    m_pending = Edit();
+    m_last = Edit();
+    m_undo.clear();
+    m_redo.clear();
+    m_replacedRedo.clear();
+    m_droppedUndo = Edit();
+}
+
+void MapEditor::record(int y, int x, int end)
+{
+    Edit &edit = m_pending;
+    if (edit.cells == 0)
+    {
+        edit.left = x;
+        edit.top = y;
+        edit.right = end;
+        edit.bottom = y + 1;
+    }
+    else
+    {
+        edit.left = min(edit.left, x);
+        edit.top = min(edit.top, y);
+        edit.right = max(edit.right, end);
+        edit.bottom = max(edit.bottom, y + 1);
+    }
+    edit.cells += end - x;
+    // a run that carries on the last one, as a line drawn along a row does
+    if (!edit.runs.empty())
+    {
+        Run &last = edit.runs.back();
+        if (last.y == y && last.x + last.length == x)
+        {
+            last.length += end - x;
+            return;
+        }
+    }
+    edit.runs.push_back({ x, y, end - x });
+}
+
+void MapEditor::setRow(WallMap &map, int y, int x, int end, bool wall)
+{
+    while (x < end)
+    {
+        // the next run of cells that are not what they should be
+        int begin = wall ? map.nextFloorInRow(y, x, end) : map.nextWallInRow(y, x, end);
+        if (begin == end)
+            break;
+        x = wall ? map.nextWallInRow(y, begin, end) : map.nextFloorInRow(y, begin, end);
+        map.fillRow(y, begin, x, wall);
+        record(y, begin, x);
+    }
+}
+
+bool MapEditor::commit()
+{
+    Edit edit;
+    swap(edit, m_pending);
+    if (edit.cells == 0)
+        return false;
+    m_last = edit;
+    m_undo.push_back(move(edit));
+    // keep what the edit replaces until the next one, in case it is reverted
+    m_droppedUndo = Edit();
+    if (m_undo.size() > MaxHistory)
+    {
+        m_droppedUndo = move(m_undo.front());
+        m_undo.erase(m_undo.begin());
+    }
+    swap(m_replacedRedo, m_redo);
+    m_redo.clear();
+    return true;
+}
+
+void MapEditor::flip(WallMap &map, const Edit &edit)
+{
+    for (const Run &run : edit.runs)
+        map.flipRow(run.y, run.x, run.x + run.length);
+}
+
+bool MapEditor::fillRect(WallMap &map, int x0, int y0, int x1, int y1, bool wall)
+{
+    int left = max(0, min(x0, x1)), right = min(map.width(), max(x0, x1) + 1);
+    int top = max(0, min(y0, y1)), bottom = min(map.height(), max(y0, y1) + 1);
+    for (int y = top; y < bottom; y++)
+        setRow(map, y, left, right, wall);
+    return commit();
+}
+
+bool MapEditor::drawLine(WallMap &map, int x0, int y0, int x1, int y1, bool wall)
+{
+    // Bresenham
+    int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+    int stepX = x0 < x1 ? 1 : -1, stepY = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+    for (;;)
+    {
+        if (map.inBounds(x0, y0))
+            setRow(map, y0, x0, x0 + 1, wall);
+        if (x0 == x1 && y0 == y1)
+            break;
+        int twice = 2 * error;
+        if (twice >= dy)
+        {
+            error += dy;
+            x0 += stepX;
+        }
+        if (twice <= dx)
+        {
+            error += dx;
+            y0 += stepY;
+        }
+    }
+    return commit();
+}
+
+bool MapEditor::floodFill(WallMap &map, int x, int y)
+{
+    if (!map.inBounds(x, y))
+        return false;
+    bool target = map.isWall(x, y);
+    // first cell at or after x in [x, end) of row y that is (or is not) like the target
+    auto nextLike = [&](int row, int from, int end)
+    {
+        return target ? map.nextWallInRow(row, from, end) : map.nextFloorInRow(row, from, end);
+    };
+    auto nextUnlike = [&](int row, int from, int end)
+    {
+        return target ? map.nextFloorInRow(row, from, end) : map.nextWallInRow(row, from, end);
+    };
+
+    // Scanline fill: widen each seed to the whole run it is in, flip the
+    // run, and seed the runs of target cells touching it above and below
+    m_seeds.clear();
+    m_seeds.emplace_back(x, y);
+    while (!m_seeds.empty())
+    {
+        int seedX = m_seeds.back().first, row = m_seeds.back().second;
+        m_seeds.pop_back();
+        if (map.isWall(seedX, row) != target)
+            continue;
+        int left = seedX;
+        while (left > 0 && map.isWall(left - 1, row) == target)
+            left--;
+        int right = nextUnlike(row, seedX, map.width());
+        map.fillRow(row, left, right, !target);
+        record(row, left, right);
+
+        for (int next : { row - 1, row + 1 })
+        {
+            if (next < 0 || next >= map.height())
+                continue;
+            for (int from = left; ; )
+            {
+                int begin = nextLike(next, from, right);
+                if (begin == right)
+                    break;
+                m_seeds.emplace_back(begin, next);
+                from = nextUnlike(next, begin, right);
+            }
+        }
+    }
+    return commit();
+}
+
+void MapEditor::copy(const WallMap &map, int x0, int y0, int x1, int y1)
+{
+    int left = max(0, min(x0, x1)), right = min(map.width(), max(x0, x1) + 1);
+    int top = max(0, min(y0, y1)), bottom = min(map.height(), max(y0, y1) + 1);
+    if (left >= right || top >= bottom)
+        return;
+    m_clipboard.resize(right - left, bottom - top);
+    for (int y = top; y < bottom; y++)
+        for (int x = left; x < right; x++)
+            m_clipboard.setWall(x - left, y - top, map.isWall(x, y));
+}
+
+bool MapEditor::paste(WallMap &map, int x, int y)
+{
+    int right = min(map.width(), x + m_clipboard.width());
+    int bottom = min(map.height(), y + m_clipboard.height());
+    for (int row = max(0, y); row < bottom; row++)
+    {
+        // copy the clipboard row a run of equal cells at a time
+        int clipRow = row - y;
+        for (int column = max(0, x); column < right; )
+        {
+            bool wall = m_clipboard.isWall(column - x, clipRow);
+            int end = x + (wall ? m_clipboard.nextFloorInRow(clipRow, column - x, right - x)
+                                : m_clipboard.nextWallInRow(clipRow, column - x, right - x));
+            setRow(map, row, column, end, wall);
+            column = end;
+        }
+    }
+    return commit();
+}
+
+bool MapEditor::undo(WallMap &map)
+{
+    if (m_undo.empty())
+        return false;
+    flip(map, m_undo.back());
+    m_last = m_undo.back();
+    m_redo.push_back(move(m_undo.back()));
+    m_undo.pop_back();
+    return true;
+}
+
+bool MapEditor::redo(WallMap &map)
+{
+    if (m_redo.empty())
+        return false;
+    flip(map, m_redo.back());
+    m_last = m_redo.back();
+    m_undo.push_back(move(m_redo.back()));
+    m_redo.pop_back();
+    return true;
+}
+
+void MapEditor::revert(WallMap &map)
+{
+    if (m_undo.empty())
+        return;
+    flip(map, m_undo.back());
+    m_last = m_undo.back();
+    m_undo.pop_back();
+    if (m_droppedUndo.cells)
+        m_undo.insert(m_undo.begin(), move(m_droppedUndo));
+    m_droppedUndo = Edit();
+    swap(m_redo, m_replacedRedo);
+    m_replacedRedo.clear();
+}
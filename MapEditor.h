@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "WallMap.h"
+
+// Bulk edits of a WallMap (rectangles, lines, flood fills and pasted
+// regions) with undo and redo.
+//
+// An edit is recorded as the runs of cells it flipped, so undoing or
+// redoing it flips the same runs again and costs as much as the edit did,
+// however big the map is. The history is only right while every change
+// to the map goes through the editor, anything else has to clear() it.
+//
+// Rows are filled and searched a tile row of 8 cells at a time, and the
+// flood fill works a run of cells at a time, so filling a million cells
+// takes milliseconds.
+class MapEditor
+{
+public:
+    static const size_t MaxHistory = 256;      // edits kept for undo
+
+    // cells [x, x + length) of row y
+    struct Run
+    {
+        int x, y, length;
+    };
+
+    // The cells one edit flipped
+    struct Edit
+    {
+        std::vector<Run> runs;
+        long cells = 0;
+        int left = 0, top = 0;          // bounding box of the runs, right and bottom excluded
+        int right = 0, bottom = 0;
+    };
+
+    // forget the history, for a new map or one changed behind the editor's back
+    void clear();
+
+    // Each edit returns false, and records nothing, if it changed no cell.
+    // Corners are included and can be given in any order, cells outside
+    // the map are left out.
+    bool fillRect(WallMap &map, int x0, int y0, int x1, int y1, bool wall);
+    bool drawLine(WallMap &map, int x0, int y0, int x1, int y1, bool wall);
+    // flip the cells connected to x, y (across sides, not corners) that
+    // are the same as it: fill a room with wall or hollow out a wall
+    bool floodFill(WallMap &map, int x, int y);
+    void copy(const WallMap &map, int x0, int y0, int x1, int y1);
+    bool hasClipboard() const { return m_clipboard.width() > 0; }
+    // paste the copied cells with their top left corner at x, y
+    bool paste(WallMap &map, int x, int y);
+
+    bool undo(WallMap &map);
+    bool redo(WallMap &map);
+    // undo the last edit and drop it, for an edit that was not allowed;
+    // the redo history it replaced comes back
+    void revert(WallMap &map);
+    size_t undoCount() const { return m_undo.size(); }
+    size_t redoCount() const { return m_redo.size(); }
+
+    // what the last edit, undo or redo changed
+    const Edit &lastChange() const { return m_last; }
+
+private:
+    // set cells [x, end) of row y, recording the ones that change
+    void setRow(WallMap &map, int y, int x, int end, bool wall);
+    void record(int y, int x, int end);
+    // finish the edit being recorded, false if it is empty
+    bool commit();
+    static void flip(WallMap &map, const Edit &edit);
+
+private:
+    Edit m_pending;
+    Edit m_last;
+    std::vector<Edit> m_undo;
+    std::vector<Edit> m_redo;
+    // what the last edit pushed out of the history, until the next one
+    std::vector<Edit> m_replacedRedo;
+    Edit m_droppedUndo;
+    WallMap m_clipboard;
+    std::vector<std::pair<int, int>> m_seeds;   // flood fill work list
+};
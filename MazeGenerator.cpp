@@ -0,0 +1,258 @@
+#include "MazeGenerator.h"
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+void MazeGenerator::generate(WallMap &map, int mazeWidth, int mazeHeight, int pathWidth, unsigned seed,
+                             Algorithm algorithm)
+{
+    map.resize(mapSize(mazeWidth, pathWidth), mapSize(mazeHeight, pathWidth), true);
+    begin(mazeWidth, mazeHeight, pathWidth, seed, algorithm);
+    int left, top, right, bottom;
+    while (step(map, LONG_MAX, left, top, right, bottom))
+        ;
+}
+
+void MazeGenerator::begin(int mazeWidth, int mazeHeight, int pathWidth, unsigned seed, Algorithm algorithm)
+{
+    beginRows(mazeWidth, mazeHeight, pathWidth, seed);
+    m_algorithm = algorithm;
+    m_cellsCarved = 0;
+    m_stack.clear();
+}
+
+bool MazeGenerator::step(WallMap &map, long work, int &left, int &top, int &right, int &bottom)
+{
+    int minX = INT_MAX, minY = INT_MAX, maxX = -1, maxY = -1;
+    bool more;
+    if (m_algorithm == Eller)
+    {
+        minX = 0;
+        maxX = m_mazeWidth - 1;
+        minY = m_row;
+        for (; work > 0 && carveRow(map); work -= m_mazeWidth)
+            m_cellsCarved += m_mazeWidth;
+        maxY = m_row - 1;
+        more = m_row < m_mazeHeight;
+    }
+    else
+    {
+        more = backtrack(map, work, minX, minY, maxX, maxY);
+    }
+    // the maze cells and the walls around them
+    left = top = right = bottom = 0;
+    if (maxY >= minY)
+    {
+        left = minX * (m_pathWidth + 1);
+        top = minY * (m_pathWidth + 1);
+        right = (maxX + 1) * (m_pathWidth + 1) + 1;
+        bottom = (maxY + 1) * (m_pathWidth + 1) + 1;
+    }
+    return more;
+}
+
+const char *MazeGenerator::algorithmName(Algorithm algorithm)
+{
+    return algorithm == Eller ? "ELLER" : "BACKTRACKER";
+}
+
+void MazeGenerator::carveCell(WallMap &map, int x, int y) const
+{
+    int mapX = x * (m_pathWidth + 1) + 1;
+    int mapY = y * (m_pathWidth + 1) + 1;
+    for (int py = 0; py < m_pathWidth; py++)
+        map.fillRow(mapY + py, mapX, mapX + m_pathWidth, false);
+}
+
+void MazeGenerator::carveEast(WallMap &map, int x, int y) const
+{
+    int mapX = x * (m_pathWidth + 1) + m_pathWidth + 1;
+    int mapY = y * (m_pathWidth + 1) + 1;
+    for (int p = 0; p < m_pathWidth; p++)
+        map.setWall(mapX, mapY + p, false);
+}
+
+void MazeGenerator::carveSouth(WallMap &map, int x, int y) const
+{
+    int mapX = x * (m_pathWidth + 1) + 1;
+    int mapY = y * (m_pathWidth + 1) + m_pathWidth + 1;
+    map.fillRow(mapY, mapX, mapX + m_pathWidth, false);
+}
+
+bool MazeGenerator::backtrack(WallMap &map, long work, int &minX, int &minY, int &maxX, int &maxY)
+{
+    // a cell is visited once its floor has been carved, so the map itself
+    // is the visited set
+    if (m_cellsCarved == 0)
+    {
+        m_stack.push_back(0);
+        carveCell(map, 0, 0);
+        m_cellsCarved++;
+        minX = minY = 0;
+        maxX = max(maxX, 0);
+        maxY = max(maxY, 0);
+    }
+
+    while (!m_stack.empty() && work > 0)
+    {
+        uint32_t top = m_stack.back();
+        int x = top % m_mazeWidth;
+        int y = top / m_mazeWidth;
+
+        // unvisited neighbours: 0 north, 1 east, 2 south, 3 west
+        int neighbours[4];
+        int count = 0;
+        if (y > 0 && !isCarved(map, x, y - 1))
+            neighbours[count++] = 0;
+        if (x < m_mazeWidth - 1 && !isCarved(map, x + 1, y))
+            neighbours[count++] = 1;
+        if (y < m_mazeHeight - 1 && !isCarved(map, x, y + 1))
+            neighbours[count++] = 2;
+        if (x > 0 && !isCarved(map, x - 1, y))
+            neighbours[count++] = 3;
+
+        if (count == 0)
+        {
+            // dead end -> back track
+            m_stack.pop_back();
+            continue;
+        }
+
+        // open a passage to a random neighbour and move there
+        switch (neighbours[count == 1 ? 0 : m_random.below(count)])
+        {
+        case 0: // North
+            carveSouth(map, x, y - 1);
+            y--;
+            break;
+        case 1: // East
+            carveEast(map, x, y);
+            x++;
+            break;
+        case 2: // South
+            carveSouth(map, x, y);
+            y++;
+            break;
+        case 3: // West
+            carveEast(map, x - 1, y);
+            x--;
+            break;
+        }
+        carveCell(map, x, y);
+        m_stack.push_back((uint32_t)y * m_mazeWidth + x);
+        m_cellsCarved++;
+        work--;
+        minX = min(minX, x);
+        minY = min(minY, y);
+        maxX = max(maxX, x);
+        maxY = max(maxY, y);
+    }
+    return !m_stack.empty();
+}
+
+void MazeGenerator::beginRows(int mazeWidth, int mazeHeight, int pathWidth, unsigned seed)
+{
+    m_random.reseed(seed);
+    m_mazeWidth = mazeWidth;
+    m_mazeHeight = mazeHeight;
+    m_pathWidth = pathWidth;
+    m_row = 0;
+    m_cellSet.assign(mazeWidth, -1);
+    m_parent.resize(mazeWidth);
+    m_setSize.resize(mazeWidth + 1);
+    m_continues.resize(mazeWidth);
+}
+
+int MazeGenerator::findSet(int set)
+{
+    while (m_parent[set] != set)
+    {
+        m_parent[set] = m_parent[m_parent[set]];
+        set = m_parent[set];
+    }
+    return set;
+}
+
+bool MazeGenerator::carveRow(WallMap &map)
+{
+    if (m_row >= m_mazeHeight)
+        return false;
+    const int width = m_mazeWidth;
+    const int y = m_row;
+    const bool lastRow = y == m_mazeHeight - 1;
+    const int mapY = y * (m_pathWidth + 1) + 1;
+    int *cellSet = m_cellSet.data();
+    int *setSize = m_setSize.data();
+    char *continues = m_continues.data();
+    int *parent = m_parent.data();
+
+    // Most of the choices below are coin flips, so they are written as
+    // selects rather than branches that would be mispredicted half the time.
+
+    // cells not reached from above start a set of their own. There are never
+    // more sets than cells, so set labels fit in [0, width) and there are
+    // always enough unused labels to hand out. Cells without a set count
+    // into the spare slot at the end, and the unused labels are listed in
+    // m_parent before the union-find forest is reset.
+    fill(m_setSize.begin(), m_setSize.end(), 0);
+    for (int x = 0; x < width; x++)
+        setSize[cellSet[x] < 0 ? width : cellSet[x]]++;
+    int freeSets = 0;
+    for (int set = 0; set < width; set++)
+    {
+        parent[freeSets] = set;
+        freeSets += setSize[set] == 0;
+    }
+    for (int x = 0, next = 0; x < width; x++)
+    {
+        bool fresh = cellSet[x] < 0;
+        cellSet[x] = fresh ? parent[next] : cellSet[x];
+        next += fresh;
+    }
+    for (int set = 0; set < width; set++)
+        parent[set] = set;
+
+    // open the whole row, then randomly join neighbours of different sets
+    // and put the walls back between the others. The last row joins all of
+    // them so that the whole maze is connected.
+    for (int py = 0; py < m_pathWidth; py++)
+        map.fillRow(mapY + py, 1, map.width() - 1, false);
+    for (int x = 0; x < width - 1; x++)
+    {
+        int left = findSet(cellSet[x]);
+        int right = findSet(cellSet[x + 1]);
+        bool join = left != right && (lastRow | m_random.bit());
+        parent[right] = join ? left : right;
+        int mapX = x * (m_pathWidth + 1) + m_pathWidth + 1;
+        for (int py = 0; py < m_pathWidth; py++)
+            map.setWall(mapX, mapY + py, !join);
+    }
+
+    m_row++;
+    if (lastRow)
+        return true;
+
+    // every set continues down through at least one of its cells, the
+    // others randomly. A set that has not continued by its last cell is
+    // forced to continue there.
+    fill(m_setSize.begin(), m_setSize.end(), 0);
+    fill(m_continues.begin(), m_continues.end(), 0);
+    for (int x = 0; x < width; x++)
+    {
+        cellSet[x] = findSet(cellSet[x]);
+        setSize[cellSet[x]]++;
+    }
+    const int southY = mapY + m_pathWidth;
+    for (int x = 0; x < width; x++)
+    {
+        int set = cellSet[x];
+        bool lastOfSet = --setSize[set] == 0;
+        bool down = m_random.bit() | (lastOfSet & !continues[set]);
+        continues[set] |= down;
+        cellSet[x] = down ? set : -1;
+        int mapX = x * (m_pathWidth + 1) + 1;
+        map.fillRow(southY, mapX, mapX + m_pathWidth, !down);
+    }
+    return true;
+}
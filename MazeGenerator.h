@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Random.h"
+#include "WallMap.h"
+
+// Carves random mazes into a WallMap. Each maze cell becomes a
+// pathWidth x pathWidth block of floor in the map, separated from its
+// neighbours by one cell thick walls.
+//
+// Two algorithms are available:
+// - Backtracker: the recursive backtracker, long winding corridors. Uses
+//   the map itself to remember visited cells, so apart from the stack of
+//   the current path nothing is allocated, but that stack can grow to the
+//   number of cells.
+// - Eller: Eller's algorithm, carves one row at a time and only keeps the
+//   set of each cell of the current row, so memory is O(width) and the
+//   maze can be streamed into the map row by row whatever its height.
+//
+// The same seed always gives the same maze.
+class MazeGenerator
+{
+public:
+    enum Algorithm { Backtracker, Eller };
+
+    // Resize map to fit a mazeWidth x mazeHeight maze and carve it
+    void generate(WallMap &map, int mazeWidth, int mazeHeight, int pathWidth, unsigned seed,
+                  Algorithm algorithm = Backtracker);
+
+    // Carve a maze a piece at a time, e.g. on a worker thread. begin()
+    // starts a maze, then each step() carves about work maze cells into
+    // map, which must already be mapSize() cells large and all walls, and
+    // sets [left, right) x [top, bottom) to the map cells it changed.
+    // Returns false once the maze is complete.
+    void begin(int mazeWidth, int mazeHeight, int pathWidth, unsigned seed, Algorithm algorithm);
+    bool step(WallMap &map, long work, int &left, int &top, int &right, int &bottom);
+    // maze cells carved so far
+    long cellsCarved() const { return m_cellsCarved; }
+
+    // Eller's algorithm one maze row at a time. beginRows() starts a maze,
+    // then each carveRow() carves the next row into map, which must already
+    // be mapSize() cells large and all walls. Returns false once every row
+    // has been carved.
+    void beginRows(int mazeWidth, int mazeHeight, int pathWidth, unsigned seed);
+    bool carveRow(WallMap &map);
+    // number of maze rows carved so far
+    int rowsCarved() const { return m_row; }
+
+    static const char *algorithmName(Algorithm algorithm);
+
+    // number of map cells needed along an axis with mazeCells maze cells
+    static int mapSize(int mazeCells, int pathWidth) { return mazeCells * (pathWidth + 1) + 1; }
+
+private:
+    // carve up to work cells with the backtracker, widening the range of
+    // maze cells [minX, maxX] x [minY, maxY] by the ones it carved
+    bool backtrack(WallMap &map, long work, int &minX, int &minY, int &maxX, int &maxY);
+
+    // open the floor of maze cell (x, y), or the wall to its east or south
+    void carveCell(WallMap &map, int x, int y) const;
+    void carveEast(WallMap &map, int x, int y) const;
+    void carveSouth(WallMap &map, int x, int y) const;
+    bool isCarved(const WallMap &map, int x, int y) const
+    {
+        return !map.isWall(x * (m_pathWidth + 1) + 1, y * (m_pathWidth + 1) + 1);
+    }
+
+    int findSet(int set);
+
+private:
+    Random m_random;
+    int m_mazeWidth = 0;
+    int m_mazeHeight = 0;
+    int m_pathWidth = 1;
+    Algorithm m_algorithm = Backtracker;
+    long m_cellsCarved = 0;
+
+    // backtracker path, cells as y * width + x
+    std::vector<uint32_t> m_stack;
+
+    // Eller's state for the current row: the set of each cell (-1 for a
+    // cell that no passage from above reaches yet), a union-find forest over
+    // the set labels, how many cells of each set are left to visit and
+    // whether a set already continues to the next row
+    int m_row = 0;
+    std::vector<int> m_cellSet;
+    std::vector<int> m_parent;
+    std::vector<int> m_setSize;
+    std::vector<char> m_continues;
+};
@@ -0,0 +1,86 @@
+#include "MazeStreamer.h"
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+void MazeStreamer::start(WallMap &map, int mazeWidth, int mazeHeight, int pathWidth, unsigned seed,
+                         MazeGenerator::Algorithm algorithm)
+{
+    cancel();
+    int width = MazeGenerator::mapSize(mazeWidth, pathWidth);
+    int height = MazeGenerator::mapSize(mazeHeight, pathWidth);
+    map.resize(width, height, true);
+    m_map.resize(width, height, true);
+    m_generator.begin(mazeWidth, mazeHeight, pathWidth, seed, algorithm);
+    m_batches.clear();
+    m_cancel = false;
+    m_done = false;
+    m_carved = 0;
+    m_total = (long)mazeWidth * mazeHeight;
+    m_active = true;
+    m_worker = thread(&MazeStreamer::work, this);
+}
+
+void MazeStreamer::cancel()
+{
+    if (m_worker.joinable())
+    {
+        m_cancel = true;
+        m_worker.join();
+    }
+    m_batches.clear();
+    m_active = false;
+}
+
+void MazeStreamer::work()
+{
+    bool more = true;
+    while (more && !m_cancel)
+    {
+        int left, top, right, bottom;
+        more = m_generator.step(m_map, BatchWork, left, top, right, bottom);
+        m_carved = m_generator.cellsCarved();
+        if (top >= bottom)
+            continue;
+        // copy the cells out here, the worker's map keeps changing
+        Batch batch;
+        batch.left = left & ~7;
+        batch.top = top;
+        batch.cells.resize(right - batch.left, bottom - top);
+        batch.cells.copyRect(m_map, batch.left, top, 0, 0, right - batch.left, bottom - top);
+        lock_guard<mutex> lock(m_mutex);
+        m_batches.push_back(move(batch));
+    }
+    m_done = true;
+}
+
+bool MazeStreamer::apply(WallMap &map, int &left, int &top, int &right, int &bottom)
+{
+    if (!m_active)
+        return false;
+    // read done first: once it is set every batch has been queued
+    bool done = m_done;
+    vector<Batch> batches;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        swap(batches, m_batches);
+    }
+    left = top = INT_MAX;
+    right = bottom = 0;
+    for (const Batch &batch : batches)
+    {
+        const WallMap &cells = batch.cells;
+        map.copyRect(cells, 0, 0, batch.left, batch.top, cells.width(), cells.height());
+        left = min(left, batch.left);
+        top = min(top, batch.top);
+        right = max(right, batch.left + cells.width());
+        bottom = max(bottom, batch.top + cells.height());
+    }
+    if (done)
+    {
+        m_worker.join();
+        m_active = false;
+    }
+    return !batches.empty();
+}
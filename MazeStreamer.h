@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MazeGenerator.h"
+#include "WallMap.h"
+
+// Generates a maze on a worker thread and hands it to the UI thread in
+// batches, so a big maze appears a piece at a time instead of freezing
+// the program until it is done.
+//
+// The worker carves into a map of its own. After every BatchWork maze
+// cells it copies the rectangle of map cells it changed, widened to whole
+// tiles, into a batch and queues it. The backtracker wanders, so a batch
+// is a small part of the rows it touched.
+// apply(), called by the UI thread whenever it likes, copies the queued
+// batches into the live map. Only the queue is shared and locked, the
+// live map is only ever written by the thread that also renders it, so
+// reading it needs no locks.
+class MazeStreamer
+{
+public:
+    static const long BatchWork = 1 << 14;     // maze cells carved between batches
+
+    MazeStreamer() = default;
+    ~MazeStreamer() { cancel(); }
+    MazeStreamer(const MazeStreamer &) = delete;
+    MazeStreamer &operator=(const MazeStreamer &) = delete;
+
+    // Start generating a maze, cancelling one still in progress. map is
+    // resized to fit the maze, all walls, for the maze to stream into.
+    void start(WallMap &map, int mazeWidth, int mazeHeight, int pathWidth, unsigned seed,
+               MazeGenerator::Algorithm algorithm);
+    // Stop the worker and drop what it has not handed over yet. The live
+    // map keeps the part of the maze that was applied.
+    void cancel();
+
+    // Copy the cells handed over since the last call into map, false if
+    // there were none. [left, right) x [top, bottom) is set to the cells
+    // the batches covered.
+    bool apply(WallMap &map, int &left, int &top, int &right, int &bottom);
+    // a maze is being generated, or has batches left to apply
+    bool active() const { return m_active; }
+    // share of the maze carved so far, 0 to 1
+    float progress() const { return m_total > 0 ? (float)m_carved / m_total : 0.0f; }
+
+private:
+    struct Batch
+    {
+        int left, top;          // left is a multiple of 8
+        WallMap cells;
+    };
+
+    void work();
+
+private:
+    std::thread m_worker;
+    MazeGenerator m_generator;      // these two belong to the worker while it runs
+    WallMap m_map;
+    std::mutex m_mutex;
+    std::vector<Batch> m_batches;   // handed over, waiting for apply()
+    std::atomic<bool> m_cancel{false};
+    std::atomic<bool> m_done{false};
+    std::atomic<long> m_carved{0};
+    long m_total = 0;
+    bool m_active = false;
+};
@@ -0,0 +1,218 @@
+#include "MiniMap.h"
+#include <algorithm>
+
+using namespace std;
+
+void MiniMap::resize(int width, int height)
+{
+    width &= ~1;
+    if (width == m_frame.width() && height == m_frame.height())
+        return;
+    m_frame.resize(width, height);
+    m_redrawAll = true;
+}
+
+void MiniMap::setOverview(bool overview)
+{
+    if (overview == m_overview)
+        return;
+    m_overview = overview;
+    m_redrawAll = true;
+}
+
+void MiniMap::cellChanged(int x, int y)
+{
+    if (m_redrawAll || x < m_originX || y < m_originY)
+        return;
+    int viewX = (x - m_originX) / m_scale;
+    int viewY = (y - m_originY) / m_scale;
+    if (viewX >= viewCells() || viewY >= height())
+        return;
+    // past one entry per view cell a full redraw is cheaper
+    if ((int)m_dirty.size() >= viewCells() * height())
+    {
+        m_redrawAll = true;
+        m_dirty.clear();
+        return;
+    }
+    m_dirty.emplace_back(viewX, viewY);
+}
+
+void MiniMap::regionChanged(int left, int top, int right, int bottom)
+{
+    if (m_redrawAll)
+        return;
+    // the view cells over the region
+    int viewLeft = (max(left, m_originX) - m_originX) / m_scale;
+    int viewTop = (max(top, m_originY) - m_originY) / m_scale;
+    int viewRight = min(viewCells(), (right - 1 - m_originX) / m_scale + 1);
+    int viewBottom = min(height(), (bottom - 1 - m_originY) / m_scale + 1);
+    if (right <= m_originX || bottom <= m_originY || viewLeft >= viewRight || viewTop >= viewBottom)
+        return;
+    if ((long)m_dirty.size() + (long)(viewRight - viewLeft) * (viewBottom - viewTop) >= (long)viewCells() * height())
+    {
+        m_redrawAll = true;
+        m_dirty.clear();
+        return;
+    }
+    for (int y = viewTop; y < viewBottom; y++)
+        for (int x = viewLeft; x < viewRight; x++)
+            m_dirty.emplace_back(x, y);
+}
+
+int MiniMap::scrollOrigin(int origin, int focus, int size, int mapSize) const
+{
+    if (mapSize <= size)
+        return 0;
+    // recentre once the focus is within a quarter of the view of an edge
+    int margin = size / 4;
+    if (focus < origin + margin || focus >= origin + size - margin)
+        origin = focus - size / 2;
+    return max(0, min(origin, mapSize - size));
+}
+
+void MiniMap::update(const WallMap &map, int focusX, int focusY, int markerX, int markerY)
+{
+    m_changed.clear();
+    m_redrewAll = false;
+    int cells = viewCells();
+    int rows = height();
+    if (cells <= 0 || rows <= 0)
+        return;
+
+    if (map.width() != m_mapWidth || map.height() != m_mapHeight)
+    {
+        m_mapWidth = map.width();
+        m_mapHeight = map.height();
+        m_redrawAll = true;
+    }
+
+    int scale = 1;
+    int originX = 0, originY = 0;
+    if (m_overview)
+    {
+        scale = max(1, max((m_mapWidth + cells - 1) / cells, (m_mapHeight + rows - 1) / rows));
+    }
+    else
+    {
+        originX = scrollOrigin(m_originX, focusX, cells, m_mapWidth);
+        originY = scrollOrigin(m_originY, focusY, rows, m_mapHeight);
+    }
+    if (scale != m_scale || originX != m_originX || originY != m_originY)
+    {
+        m_scale = scale;
+        m_originX = originX;
+        m_originY = originY;
+        m_redrawAll = true;
+    }
+
+    // the marker moves: redraw the cell it leaves and the one it enters
+    int oldMarkerX = m_markerX, oldMarkerY = m_markerY;
+    m_markerX = markerX >= m_originX ? (markerX - m_originX) / m_scale : -1;
+    m_markerY = markerY >= m_originY ? (markerY - m_originY) / m_scale : -1;
+
+    if (m_redrawAll)
+    {
+        for (int y = 0; y < rows; y++)
+            for (int x = 0; x < cells; x++)
+                drawCell(map, x, y);
+        m_redrawAll = false;
+        m_redrewAll = true;
+        m_dirty.clear();
+        return;
+    }
+
+    if (m_markerX != oldMarkerX || m_markerY != oldMarkerY)
+    {
+        m_dirty.emplace_back(oldMarkerX, oldMarkerY);
+        m_dirty.emplace_back(m_markerX, m_markerY);
+    }
+    for (const auto &cell : m_dirty)
+    {
+        if (cell.first < 0 || cell.first >= cells || cell.second < 0 || cell.second >= rows)
+            continue;
+        // the same cell can be listed more than once, only report it the first time
+        Cell before = m_frame.at(2 * cell.first, cell.second);
+        drawCell(map, cell.first, cell.second);
+        if (m_frame.at(2 * cell.first, cell.second) != before)
+            m_changed.push_back(cell);
+    }
+    m_dirty.clear();
+}
+
+void MiniMap::drawCell(const WallMap &map, int viewX, int viewY)
+{
+    wchar_t ch = ' ';
+    short color = 0;
+    int x = m_originX + viewX * m_scale;
+    int y = m_originY + viewY * m_scale;
+    if (viewX == m_markerX && viewY == m_markerY)
+    {
+        color = MarkerColor;
+    }
+    else if (x >= m_mapWidth || y >= m_mapHeight)
+    {
+        // past the edge of the map
+    }
+    else if (m_scale == 1)
+    {
+        if (map.isWall(x, y))
+        {
+            color = WallColor;
+        }
+        else if (m_lightmap && !m_lightmap->empty())
+        {
+            uint8_t light = m_lightmap->cellLight(x, y);
+            if (m_lightmap->hasLight(x, y))
+                ch = '*', color = OverviewColor;
+            else if (light >= 200)
+                ch = L'▓', color = OverviewColor;
+            else if (light >= 150)
+                ch = L'▒', color = OverviewColor;
+            else if (light >= 100)
+                ch = L'░', color = OverviewColor;
+        }
+    }
+    else
+    {
+        // shade by the share of walls on up to 8 rows spread over the block
+        int endX = min(x + m_scale, m_mapWidth);
+        int endY = min(y + m_scale, m_mapHeight);
+        int samples = min(8, endY - y);
+        int walls = 0;
+        for (int i = 0; i < samples; i++)
+            walls += map.countWallsInRow(y + (endY - y) * i / samples, x, endX);
+        float share = (float)walls / (samples * (endX - x));
+        if (share >= 0.75f)
+            color = WallColor;
+        else if (share >= 0.5f)
+            ch = L'▒', color = OverviewColor;
+        else if (share >= 0.25f)
+            ch = L'░', color = OverviewColor;
+    }
+    m_frame.set(2 * viewX, viewY, ch, color);
+    m_frame.set(2 * viewX + 1, viewY, ch, color);
+}
+
+bool MiniMap::toFrame(int x, int y, int &frameX, int &frameY) const
+{
+    if (x < m_originX || y < m_originY)
+        return false;
+    frameX = 2 * ((x - m_originX) / m_scale);
+    frameY = (y - m_originY) / m_scale;
+    return frameX < m_frame.width() && frameY < m_frame.height();
+}
+
+void MiniMap::present(OutputBackend &output, int left, int top) const
+{
+    if (m_redrewAll)
+    {
+        for (int y = 0; y < m_frame.height(); y++)
+            output.drawCells(m_frame, y, 0, m_frame.width(), left, top);
+    }
+    else
+    {
+        for (const auto &cell : m_changed)
+            output.drawCells(m_frame, cell.second, 2 * cell.first, 2 * cell.first + 2, left, top);
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <utility>
+#include <vector>
+
+#include "FrameBuffer.h"
+#include "Lightmap.h"
+#include "OutputBackend.h"
+#include "WallMap.h"
+
+// Top down view of the map around a point of interest, drawn into a
+// FrameBuffer two characters per cell. Knows nothing about the terminal.
+//
+// The view only redraws what changed since the last update: the cells
+// that were edited and the old and new marker cells. The whole view is
+// only redrawn when it scrolls, which it does by recentring once the
+// focus gets close to an edge, so the cost of an update never depends on
+// the size of the map.
+//
+// In overview mode the whole map is shrunk to fit the view, each cell of
+// the view shaded by how much of its block of the map is wall.
+class MiniMap
+{
+public:
+    // colour pairs the cells are drawn with
+    static const short WallColor = 1;
+    static const short MarkerColor = 2;
+    static const short OverviewColor = 4;
+
+    // size of the view in characters, each map cell is two characters wide
+    void resize(int width, int height);
+    int width() const { return m_frame.width(); }
+    int height() const { return m_frame.height(); }
+
+    // Shade floor cells by this baked light and mark the lights, nullptr
+    // for none. Not owned by the minimap, tell it about cells baked again
+    // with regionChanged().
+    void setLightmap(const Lightmap *lightmap) { m_lightmap = lightmap; }
+
+    void setOverview(bool overview);
+    bool overview() const { return m_overview; }
+    // map cells per view cell along each axis, 1 unless in overview mode
+    int scale() const { return m_scale; }
+
+    // Redraw everything on the next update, for a new map or a window
+    // that lost its contents
+    void invalidate() { m_redrawAll = true; }
+    // map cell x, y was edited
+    void cellChanged(int x, int y);
+    // map cells [left, right) x [top, bottom) were edited, only the part
+    // of the view over them is redrawn
+    void regionChanged(int left, int top, int right, int bottom);
+
+    // Bring the view up to date with the map, keeping the map cell
+    // focusX, focusY in view and marking markerX, markerY
+    void update(const WallMap &map, int focusX, int focusY, int markerX, int markerY);
+
+    const FrameBuffer &frame() const { return m_frame; }
+    // What the last update redrew: everything, or the view cells listed
+    // in changedCells(), each two characters at (2 * x, y) of the frame
+    bool redrewAll() const { return m_redrewAll; }
+    const std::vector<std::pair<int, int>> &changedCells() const { return m_changed; }
+    // send what the last update redrew, with the view's top left corner at left, top
+    void present(OutputBackend &output, int left, int top) const;
+
+    // Position of map cell x, y in the frame, false if it is out of view
+    bool toFrame(int x, int y, int &frameX, int &frameY) const;
+
+private:
+    int viewCells() const { return m_frame.width() / 2; }
+    void drawCell(const WallMap &map, int viewX, int viewY);
+    // origin along one axis that keeps focus in a view of size cells
+    int scrollOrigin(int origin, int focus, int size, int mapSize) const;
+
+private:
+    FrameBuffer m_frame;
+    const Lightmap *m_lightmap = nullptr;
+    bool m_overview = false;
+    int m_scale = 1;
+    int m_mapWidth = -1;
+    int m_mapHeight = -1;
+    int m_originX = 0;          // map cell at the top left of the view
+    int m_originY = 0;
+    int m_markerX = -1;         // view cell of the marker as last drawn
+    int m_markerY = -1;
+    bool m_redrawAll = true;
+    bool m_redrewAll = false;
+    std::vector<std::pair<int, int>> m_dirty;       // view cells to redraw
+    std::vector<std::pair<int, int>> m_changed;
+};
@@ -0,0 +1,76 @@
+#include "NcursesOutput.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+NcursesOutput::NcursesOutput()
+{
+    m_ioFile = open("/proc/self/io", O_RDONLY);
+}
+
+NcursesOutput::~NcursesOutput()
+{
+    if (m_ioFile >= 0)
+        close(m_ioFile);
+}
+
+void NcursesOutput::drawCells(const FrameBuffer &frame, int y, int begin, int end, int left, int top)
+{
+    m_rowBuffer.resize(frame.width());
+    const Cell *row = frame.row(y);
+    for (int x = begin; x < end; x++)
+    {
+        wchar_t ch[2] = { row[x].ch, 0 };
+        setcchar(&m_rowBuffer[x - begin], ch, 0, row[x].colorPair, NULL);
+    }
+    mvwadd_wchnstr(window(), top + y, left + begin, m_rowBuffer.data(), end - begin);
+}
+
+void NcursesOutput::drawText(int x, int y, const char *text)
+{
+    mvwaddstr(window(), y, x, text);
+}
+
+void NcursesOutput::drawBox(int left, int top, int width, int height)
+{
+    WINDOW *win = window();
+    mvwhline(win, top, left + 1, ACS_HLINE, width - 2);
+    mvwhline(win, top + height - 1, left + 1, ACS_HLINE, width - 2);
+    mvwvline(win, top + 1, left, ACS_VLINE, height - 2);
+    mvwvline(win, top + 1, left + width - 1, ACS_VLINE, height - 2);
+    mvwaddch(win, top, left, ACS_ULCORNER);
+    mvwaddch(win, top, left + width - 1, ACS_URCORNER);
+    mvwaddch(win, top + height - 1, left, ACS_LLCORNER);
+    mvwaddch(win, top + height - 1, left + width - 1, ACS_LRCORNER);
+}
+
+void NcursesOutput::endFrame()
+{
+    long bytesBefore, syscallsBefore, bytesAfter, syscallsAfter;
+    bool counted = readWriteCounters(bytesBefore, syscallsBefore);
+    wrefresh(window());
+    counted = counted && readWriteCounters(bytesAfter, syscallsAfter);
+    m_stats.bytes = counted ? bytesAfter - bytesBefore : 0;
+    m_stats.syscalls = counted ? syscallsAfter - syscallsBefore : 0;
+}
+
+bool NcursesOutput::readWriteCounters(long &bytes, long &syscalls) const
+{
+    if (m_ioFile < 0)
+        return false;
+    char text[512];
+    ssize_t length = pread(m_ioFile, text, sizeof(text) - 1, 0);
+    if (length <= 0)
+        return false;
+    text[length] = 0;
+    const char *wchar = strstr(text, "wchar:");
+    const char *syscw = strstr(text, "syscw:");
+    if (!wchar || !syscw)
+        return false;
+    bytes = strtol(wchar + 6, nullptr, 10);
+    syscalls = strtol(syscw + 6, nullptr, 10);
+    return true;
+}
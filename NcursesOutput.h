@@ -0,0 +1,35 @@
+#pragma once
+#include <ncurses.h>
+#include <vector>
+
+#include "OutputBackend.h"
+
+// Draws into an ncurses window and refreshes it once per frame, ncurses
+// works out what to send. The bytes and write calls of a frame are read
+// from /proc/self/io around the refresh, as ncurses does the writing.
+class NcursesOutput : public OutputBackend
+{
+public:
+    NcursesOutput();
+    ~NcursesOutput();
+
+    // window to draw into, nullptr (the default) is stdscr
+    void setWindow(WINDOW *window) { m_window = window; }
+
+    const char *name() const override { return "NCURSES"; }
+    void beginFrame() override {}
+    void drawCells(const FrameBuffer &frame, int y, int begin, int end, int left, int top) override;
+    void drawText(int x, int y, const char *text) override;
+    void drawBox(int left, int top, int width, int height) override;
+    void endFrame() override;
+
+private:
+    WINDOW *window() const { return m_window ? m_window : stdscr; }
+    // bytes and write calls of this process so far, false if unknown
+    bool readWriteCounters(long &bytes, long &syscalls) const;
+
+private:
+    WINDOW *m_window = nullptr;
+    std::vector<cchar_t> m_rowBuffer;
+    int m_ioFile = -1;
+};
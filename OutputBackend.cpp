@@ -0,0 +1,24 @@
+#include "OutputBackend.h"
+#include <algorithm>
+
+using namespace std;
+
+void OutputBackend::presentFrame(FrameBuffer &frame, int left, int top, bool changedOnly)
+{
+    // push the frame buffer one run of cells at a time
+    int last = frame.width() - 1;
+    for (int y = 1; y < frame.height() - 1; y++)
+    {
+        int begin = 1, end = last;
+        if (changedOnly && !frame.nextChangedRun(y, 1, begin, end))
+            continue;
+
+        while (begin < last)
+        {
+            drawCells(frame, y, begin, min(end, last), left, top);
+            if (!changedOnly || !frame.nextChangedRun(y, end, begin, end))
+                break;
+        }
+    }
+    frame.markPresented();
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "FrameBuffer.h"
+
+// What a backend sent to the terminal for the last frame
+struct OutputStats
+{
+    long bytes = 0;         // bytes written
+    int syscalls = 0;       // write system calls made
+};
+
+// Where frames go. The game draws each frame as runs of frame buffer
+// cells, text and boxes between beginFrame() and endFrame(), and the
+// backend decides how that reaches the terminal. Positions are in screen
+// characters.
+class OutputBackend
+{
+public:
+    virtual ~OutputBackend() = default;
+    virtual const char *name() const = 0;
+
+    virtual void beginFrame() = 0;
+    // cells [begin, end) of row y of frame, with the frame's top left
+    // corner at left, top on the screen
+    virtual void drawCells(const FrameBuffer &frame, int y, int begin, int end, int left, int top) = 0;
+    virtual void drawText(int x, int y, const char *text) = 0;
+    virtual void drawBox(int left, int top, int width, int height) = 0;
+    // hand the frame to the terminal and update stats()
+    virtual void endFrame() = 0;
+
+    // Forget what the terminal is known to show, e.g. after something
+    // else drew on it
+    virtual void invalidate() {}
+
+    // Draw frame with its top left corner at left, top. The outermost
+    // cells are under a box and never sent. With changedOnly only the runs
+    // of cells that differ from the last presented frame are sent.
+    void presentFrame(FrameBuffer &frame, int left, int top, bool changedOnly);
+
+    const OutputStats &stats() const { return m_stats; }
+
+protected:
+    OutputStats m_stats;
+};
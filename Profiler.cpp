@@ -0,0 +1,148 @@
+#include "Profiler.h"
+#include <algorithm>
+
+using namespace std;
+
+// std::min takes it by reference, so it needs a definition
+const int Profiler::AverageFrames;
+
+Profiler::Profiler()
+    : m_epoch(Clock::now())
+{
+}
+
+Profiler::~Profiler()
+{
+    stopTrace();
+}
+
+const char *Profiler::sectionName(Section section)
+{
+    switch (section)
+    {
+    case Input:     return "input";
+    case Agents:    return "agents";
+    case Render:    return "render";
+    case RayCast:   return "raycast";
+    case Shading:   return "shading";
+    case MiniMap:   return "minimap";
+    case Present:   return "present";
+    case Flush:     return "flush";
+    default:        return "?";
+    }
+}
+
+void Profiler::addRays(long steps, int maxSteps, int wallHits)
+{
+    m_current.raySteps += steps;
+    m_current.maxRaySteps = max(m_current.maxRaySteps, maxSteps);
+    m_current.wallHits += wallHits;
+}
+
+void Profiler::endFrame()
+{
+    double now = chrono::duration<double>(Clock::now() - m_epoch).count();
+    if (!enabled())
+    {
+        m_current = Frame();
+        m_current.start = now;
+        return;
+    }
+
+    m_current.duration = now - m_current.start;
+    m_last = m_current;
+    m_history[m_frameCount++ % AverageFrames] = m_current;
+    if (m_trace)
+    {
+        writeTrace(m_current);
+        fflush(m_trace);
+    }
+    m_current = Frame();
+    m_current.start = now;
+}
+
+Profiler::Frame Profiler::average() const
+{
+    Frame average;
+    int count = min(m_frameCount, AverageFrames);
+    if (count == 0)
+        return average;
+    for (int i = 0; i < count; i++)
+    {
+        const Frame &frame = m_history[i];
+        average.duration += frame.duration / count;
+        for (int section = 0; section < SectionCount; section++)
+            average.seconds[section] += frame.seconds[section] / count;
+        average.raySteps += frame.raySteps / count;
+        average.maxRaySteps = max(average.maxRaySteps, frame.maxRaySteps);
+        average.wallHits += frame.wallHits / count;
+    }
+    return average;
+}
+
+bool Profiler::startTrace(const string &fileName)
+{
+    stopTrace();
+    m_trace = fopen(fileName.c_str(), "w");
+    if (!m_trace)
+        return false;
+    m_csv = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".csv") == 0;
+    m_firstEvent = true;
+    if (m_csv)
+    {
+        fprintf(m_trace, "frame,start_ms,frame_ms");
+        for (int section = 0; section < SectionCount; section++)
+            fprintf(m_trace, ",%s_ms", sectionName((Section)section));
+        fprintf(m_trace, ",ray_steps,max_ray_steps,wall_hits\n");
+    }
+    else
+    {
+        // the array form, which trace viewers still read when the closing
+        // bracket is missing because the game was killed
+        fprintf(m_trace, "[\n");
+    }
+    return true;
+}
+
+void Profiler::stopTrace()
+{
+    if (!m_trace)
+        return;
+    if (!m_csv)
+        fprintf(m_trace, "\n]\n");
+    fclose(m_trace);
+    m_trace = nullptr;
+}
+
+void Profiler::writeTrace(const Frame &frame)
+{
+    if (m_csv)
+    {
+        fprintf(m_trace, "%d,%.3f,%.3f", m_frameCount, frame.start * 1e3, frame.duration * 1e3);
+        for (int section = 0; section < SectionCount; section++)
+            fprintf(m_trace, ",%.4f", frame.seconds[section] * 1e3);
+        fprintf(m_trace, ",%ld,%d,%d\n", frame.raySteps, frame.maxRaySteps, frame.wallHits);
+        return;
+    }
+
+    // The main thread's sections are complete events at the time they
+    // started. Ray casting and shading are summed over the render threads
+    // and go on a track of their own under the render span.
+    auto event = [&](const char *name, int track, double start, double seconds)
+    {
+        fprintf(m_trace, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f}",
+                m_firstEvent ? "" : ",\n", name, track, start * 1e6, seconds * 1e6);
+        m_firstEvent = false;
+    };
+    event("frame", 0, frame.start, frame.duration);
+    for (Section section : { Input, Agents, Render, MiniMap, Present, Flush })
+    {
+        if (frame.seconds[section] > 0)
+            event(sectionName(section), 1, frame.began[section], frame.seconds[section]);
+    }
+    event(sectionName(RayCast), 2, frame.began[Render], frame.seconds[RayCast]);
+    event(sectionName(Shading), 2, frame.began[Render] + frame.seconds[RayCast], frame.seconds[Shading]);
+    fprintf(m_trace, ",\n{\"name\":\"rays\",\"ph\":\"C\",\"pid\":1,\"ts\":%.1f,"
+            "\"args\":{\"steps\":%ld,\"max steps\":%d,\"wall hits\":%d}}",
+            frame.start * 1e6, frame.raySteps, frame.maxRaySteps, frame.wallHits);
+}
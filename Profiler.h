@@ -0,0 +1,98 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Per frame timings of the main loop's sections plus ray counts, for the
+// on-screen HUD and for export to a trace file.
+//
+// Sections are timed with Scope objects that do nothing but test a flag
+// while the profiler is off. Render is wall time; RayCast and Shading are
+// summed over the render threads, so with several threads they can add up
+// to more than Render.
+class Profiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum Section { Input, Agents, Render, RayCast, Shading, MiniMap, Present, Flush, SectionCount };
+    static const char *sectionName(Section section);
+
+    // One frame's worth of measurements
+    struct Frame
+    {
+        double start = 0;                       // seconds since the profiler was created
+        double duration = 0;                    // seconds from this frame's start to the next
+        double seconds[SectionCount] = {};
+        double began[SectionCount] = {};        // when the section first started, as start
+        long raySteps = 0;
+        int maxRaySteps = 0;                    // longest single ray
+        int wallHits = 0;
+    };
+
+    // Times a section from construction to destruction
+    class Scope
+    {
+    public:
+        Scope(Profiler &profiler, Section section)
+            : m_profiler(profiler.enabled() ? &profiler : nullptr), m_section(section)
+        {
+            if (m_profiler)
+                m_start = Clock::now();
+        }
+        ~Scope()
+        {
+            if (m_profiler)
+                m_profiler->add(m_section, m_start, Clock::now());
+        }
+
+    private:
+        Profiler *m_profiler;
+        Section m_section;
+        Clock::time_point m_start;
+    };
+
+    Profiler();
+    ~Profiler();
+
+    // The HUD and a trace each turn the profiler on
+    void setHudVisible(bool visible) { m_hudVisible = visible; }
+    bool hudVisible() const { return m_hudVisible; }
+    bool enabled() const { return m_hudVisible || m_trace; }
+
+    void add(Section section, Clock::time_point start, Clock::time_point end)
+    {
+        if (m_current.seconds[section] == 0)
+            m_current.began[section] = std::chrono::duration<double>(start - m_epoch).count();
+        m_current.seconds[section] += std::chrono::duration<double>(end - start).count();
+    }
+    void addSeconds(Section section, double seconds) { m_current.seconds[section] += seconds; }
+    void addRays(long steps, int maxSteps, int wallHits);
+
+    // Close the frame being measured, write it to the trace and start the next
+    void endFrame();
+
+    // last frame, and the average of the last AverageFrames frames
+    static const int AverageFrames = 32;
+    const Frame &lastFrame() const { return m_last; }
+    Frame average() const;
+
+    // Write every frame to fileName until stopTrace(): Chrome trace event
+    // JSON (chrome://tracing, Perfetto), or CSV if the name ends in .csv
+    bool startTrace(const std::string &fileName);
+    void stopTrace();
+
+private:
+    void writeTrace(const Frame &frame);
+
+private:
+    Clock::time_point m_epoch;
+    bool m_hudVisible = false;
+    Frame m_current;
+    Frame m_last;
+    Frame m_history[AverageFrames];
+    int m_frameCount = 0;
+    FILE *m_trace = nullptr;
+    bool m_csv = false;
+    bool m_firstEvent = true;
+};
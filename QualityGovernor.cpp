@@ -0,0 +1,63 @@
+#include "QualityGovernor.h"
+
+// Columns go first, a coarser picture is less noticeable than walls
+// disappearing into the distance
+const QualityGovernor::Level QualityGovernor::Levels[] =
+{
+    { 1, 1.0f },
+    { 2, 1.0f },
+    { 2, 0.7f },
+    { 3, 0.7f },
+    { 4, 0.5f },
+    { 4, 0.35f },
+    { 6, 0.25f },
+};
+
+int QualityGovernor::levelCount()
+{
+    return sizeof(Levels) / sizeof(Levels[0]);
+}
+
+int QualityGovernor::columnStep() const
+{
+    return Levels[m_level].columnStep;
+}
+
+float QualityGovernor::depthScale() const
+{
+    return Levels[m_level].depthScale;
+}
+
+void QualityGovernor::setBudget(double seconds)
+{
+    m_budget = seconds;
+    m_level = 0;
+    m_average = 0;
+    m_framesSinceChange = 0;
+    m_framesWithHeadroom = 0;
+}
+
+void QualityGovernor::update(double renderSeconds)
+{
+    if (m_budget <= 0)
+        return;
+    // a short moving average, one slow frame should not drop the quality
+    m_average = m_average == 0 ? renderSeconds : m_average * 0.75 + renderSeconds * 0.25;
+    m_framesSinceChange++;
+    m_framesWithHeadroom = m_average < m_budget * Headroom ? m_framesWithHeadroom + 1 : 0;
+
+    if (m_average > m_budget && m_level + 1 < levelCount() && m_framesSinceChange >= DownDelay)
+    {
+        m_level++;
+        m_framesSinceChange = 0;
+        // the average was measured at the old level
+        m_average = 0;
+    }
+    else if (m_framesWithHeadroom >= UpDelay && m_level > 0)
+    {
+        m_level--;
+        m_framesSinceChange = 0;
+        m_framesWithHeadroom = 0;
+        m_average = 0;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Picks the render quality that keeps the render time under a budget.
+//
+// Quality goes down a fixed ladder of levels, each tracing fewer columns
+// (the gaps are filled from the traced neighbour) or casting shorter rays
+// than the one before. The governor keeps a moving average of the
+// measured render times and steps down a level as soon as the average is
+// over the budget, but only steps back up after it has stayed well under
+// the budget for a while, so that it does not flip between two levels.
+class QualityGovernor
+{
+public:
+    // budget in seconds, 0 always renders at full quality
+    void setBudget(double seconds);
+    double budget() const { return m_budget; }
+
+    // feed the time the last frame took to render
+    void update(double renderSeconds);
+
+    int level() const { return m_level; }
+    static int levelCount();
+    // trace every columnStep()th column
+    int columnStep() const;
+    // share of the full ray depth to cast
+    float depthScale() const;
+    double averageSeconds() const { return m_average; }
+
+private:
+    struct Level
+    {
+        int columnStep;
+        float depthScale;
+    };
+    static const Level Levels[];
+
+    static const int DownDelay = 4;         // frames to wait after a change before going lower
+    static const int UpDelay = 60;          // frames with headroom before going higher
+    static constexpr double Headroom = 0.6; // share of the budget under which quality goes up
+
+    double m_budget = 0;
+    double m_average = 0;
+    int m_level = 0;
+    int m_framesSinceChange = 0;
+    int m_framesWithHeadroom = 0;
+};
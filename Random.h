@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+
+// Small, fast and seedable pseudo random generator (xoshiro256**).
+// Unlike rand() the sequence only depends on the seed, so a seed always
+// gives the same result on every platform, and each generator has its own
+// state so several can run on different threads.
+class Random
+{
+public:
+    explicit Random(uint64_t seed = 1) { reseed(seed); }
+
+    void reseed(uint64_t seed)
+    {
+        m_bitsLeft = 0;
+        // spread the seed over the state with splitmix64, so that close
+        // seeds still give unrelated sequences
+        for (auto &word : m_state)
+        {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next()
+    {
+        uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+        uint64_t t = m_state[1] << 17;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+        return result;
+    }
+
+    // uniform integer in [0, n), n > 0
+    uint32_t below(uint32_t n) { return (uint32_t)(((next() >> 32) * n) >> 32); }
+    // uniform float in [0, 1)
+    float unit() { return (next() >> 40) * (1.0f / 16777216.0f); }
+    bool coin() { return next() >> 63; }
+    // like coin() but takes one bit at a time from a 64 bit draw, for
+    // loops that flip a lot of coins
+    bool bit()
+    {
+        if (m_bitsLeft == 0)
+        {
+            m_bits = next();
+            m_bitsLeft = 64;
+        }
+        m_bitsLeft--;
+        bool result = m_bits & 1;
+        m_bits >>= 1;
+        return result;
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    uint64_t m_state[4];
+    uint64_t m_bits = 0;
+    int m_bitsLeft = 0;
+};
@@ -0,0 +1,288 @@
+#include "Raycaster.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// std::min takes it by reference, so it needs a definition
+const int Raycaster::MaxPacket;
+
+const char *Raycaster::modeName(Mode mode)
+{
+    switch (mode)
+    {
+    case Mode::DDA:     return "DDA";
+    case Mode::Legacy:  return "LEGACY";
+    case Mode::Field:   return "FIELD";
+    }
+    return "?";
+}
+
+void Raycaster::setEdgeThreshold(float radians)
+{
+    m_edgeThreshold = radians;
+    m_edgeSinSq = sin(radians) * sin(radians);
+}
+
+bool Raycaster::isTileEdge(const RayHit &hit, float originX, float originY, float eyeX, float eyeY) const
+{
+    if (!hit.hit)
+        return false;
+
+    // The angle between the ray and a corner is below the threshold when
+    // the corner is in front and sin^2(angle) * |v|^2 = cross^2 is small.
+    // The eye vector is unit length so no sqrt or acos is needed.
+    auto nearCorner = [&](float vx, float vy, float lengthSq)
+    {
+        float dot = eyeX * vx + eyeY * vy;
+        float cross = eyeX * vy - eyeY * vx;
+        return dot > 0 && cross * cross < m_edgeSinSq * lengthSq;
+    };
+
+    // Only the two corners closest to the origin are tested (we will never
+    // see all four), picked with a running minimum instead of a sort
+    float bestX = 0, bestY = 0, bestSq = INFINITY;
+    float nextX = 0, nextY = 0, nextSq = INFINITY;
+    for (int tx = 0; tx < 2; tx++)
+        for (int ty = 0; ty < 2; ty++)
+        {
+            float vx = (float)hit.cellX + tx - originX;
+            float vy = (float)hit.cellY + ty - originY;
+            float lengthSq = vx * vx + vy * vy;
+            if (lengthSq < bestSq)
+            {
+                nextX = bestX; nextY = bestY; nextSq = bestSq;
+                bestX = vx; bestY = vy; bestSq = lengthSq;
+            }
+            else if (lengthSq < nextSq)
+            {
+                nextX = vx; nextY = vy; nextSq = lengthSq;
+            }
+        }
+    return nearCorner(bestX, bestY, bestSq) || nearCorner(nextX, nextY, nextSq);
+}
+
+RayHit Raycaster::cast(const WallMap &map,
+                       float originX, float originY, float eyeX, float eyeY, float depth) const
+{
+    if (m_mode == Mode::Legacy)
+        return castLegacy(map, originX, originY, eyeX, eyeY, depth);
+    if (m_mode == Mode::Field && m_field && m_field->matches(map))
+        return castField(map, *m_field, originX, originY, eyeX, eyeY, depth);
+    return castDDA(map, originX, originY, eyeX, eyeY, depth);
+}
+
+RayHit Raycaster::castDDA(const WallMap &map,
+                          float originX, float originY, float eyeX, float eyeY, float depth) const
+{
+    RayHit hit;
+    hit.distance = depth;
+
+    int mapX = (int)floor(originX);
+    int mapY = (int)floor(originY);
+
+    // distance along the ray between two vertical (x) or horizontal (y) grid lines
+    float deltaX = eyeX != 0.0f ? fabs(1.0f / eyeX) : INFINITY;
+    float deltaY = eyeY != 0.0f ? fabs(1.0f / eyeY) : INFINITY;
+
+    // distance along the ray to the first grid line on each axis
+    int stepX, stepY;
+    float sideX, sideY;
+    if (eyeX < 0) { stepX = -1; sideX = (originX - mapX) * deltaX; }
+    else          { stepX = 1;  sideX = (mapX + 1.0f - originX) * deltaX; }
+    if (eyeY < 0) { stepY = -1; sideY = (originY - mapY) * deltaY; }
+    else          { stepY = 1;  sideY = (mapY + 1.0f - originY) * deltaY; }
+
+    while (true)
+    {
+        // step into whichever neighbouring cell the ray reaches first
+        float distance;
+        bool crossedX = sideX < sideY;
+        if (crossedX)
+        {
+            distance = sideX;
+            sideX += deltaX;
+            mapX += stepX;
+        }
+        else
+        {
+            distance = sideY;
+            sideY += deltaY;
+            mapY += stepY;
+        }
+
+        if (distance >= depth)
+            return hit;
+        if (!map.inBounds(mapX, mapY))
+            return hit;
+
+        hit.steps++;
+        if (map.isWall(mapX, mapY))
+        {
+            hit.hit = true;
+            hit.distance = distance;
+            hit.cellX = mapX;
+            hit.cellY = mapY;
+            finishHit(hit, crossedX, stepX, stepY, originX, originY, eyeX, eyeY);
+            return hit;
+        }
+    }
+}
+
+RayHit Raycaster::castField(const WallMap &map, const DistanceField &field,
+                            float originX, float originY, float eyeX, float eyeY, float depth) const
+{
+    RayHit hit;
+    hit.distance = depth;
+
+    int mapX = (int)floor(originX);
+    int mapY = (int)floor(originY);
+    if (!map.inBounds(mapX, mapY))
+        return castDDA(map, originX, originY, eyeX, eyeY, depth);
+
+    // same walk as castDDA
+    float deltaX = eyeX != 0.0f ? fabs(1.0f / eyeX) : INFINITY;
+    float deltaY = eyeY != 0.0f ? fabs(1.0f / eyeY) : INFINITY;
+    int stepX, stepY;
+    float sideX, sideY;
+    if (eyeX < 0) { stepX = -1; sideX = (originX - mapX) * deltaX; }
+    else          { stepX = 1;  sideX = (mapX + 1.0f - originX) * deltaX; }
+    if (eyeY < 0) { stepY = -1; sideY = (originY - mapY) * deltaY; }
+    else          { stepY = 1;  sideY = (mapY + 1.0f - originY) * deltaY; }
+
+    while (true)
+    {
+        // Every cell within reach - 1 of this one is floor and inside the
+        // map, so jump straight to the last cell the ray visits in that
+        // square. It leaves the square when it has crossed reach more grid
+        // lines on either axis.
+        int reach = field.at(mapX, mapY) - 1;
+        if (reach > 0)
+        {
+            hit.steps++;
+            float exitX = sideX + reach * deltaX;
+            float exitY = sideY + reach * deltaY;
+            float exit = min(exitX, exitY);
+            if (exit >= depth)
+                return hit;
+            // grid lines crossed before the exit on each axis, at most reach
+            auto crossings = [&](float side, float delta)
+            {
+                return side < exit ? min(reach, (int)ceil((exit - side) / delta)) : 0;
+            };
+            int crossX = exitX <= exitY ? reach : crossings(sideX, deltaX);
+            int crossY = exitX <= exitY ? crossings(sideY, deltaY) : reach;
+            // an axis the ray runs along has an infinite delta, and 0 * inf is nan
+            if (crossX > 0)
+            {
+                mapX += crossX * stepX;
+                sideX += crossX * deltaX;
+            }
+            if (crossY > 0)
+            {
+                mapY += crossY * stepY;
+                sideY += crossY * deltaY;
+            }
+        }
+
+        float distance;
+        bool crossedX = sideX < sideY;
+        if (crossedX)
+        {
+            distance = sideX;
+            sideX += deltaX;
+            mapX += stepX;
+        }
+        else
+        {
+            distance = sideY;
+            sideY += deltaY;
+            mapY += stepY;
+        }
+
+        if (distance >= depth)
+            return hit;
+        if (!map.inBounds(mapX, mapY))
+            return hit;
+
+        hit.steps++;
+        if (map.isWall(mapX, mapY))
+        {
+            hit.hit = true;
+            hit.distance = distance;
+            hit.cellX = mapX;
+            hit.cellY = mapY;
+            finishHit(hit, crossedX, stepX, stepY, originX, originY, eyeX, eyeY);
+            return hit;
+        }
+    }
+}
+
+void Raycaster::finishHit(RayHit &hit, bool crossedX, int stepX, int stepY,
+                          float originX, float originY, float eyeX, float eyeY)
+{
+    if (crossedX)
+    {
+        float hitY = originY + eyeY * hit.distance;
+        hit.face = stepX > 0 ? WallFace::West : WallFace::East;
+        hit.wallX = hitY - floor(hitY);
+    }
+    else
+    {
+        float hitX = originX + eyeX * hit.distance;
+        hit.face = stepY > 0 ? WallFace::North : WallFace::South;
+        hit.wallX = hitX - floor(hitX);
+    }
+    hit.distance = max(hit.distance, MinHitDistance);
+}
+
+RayHit Raycaster::castLegacy(const WallMap &map,
+                             float originX, float originY, float eyeX, float eyeY, float depth) const
+{
+    RayHit hit;
+    float distanceToWall = 0;
+
+    while (distanceToWall < depth)
+    {
+        distanceToWall += m_legacyStep;
+        int testX = originX + eyeX * distanceToWall;
+        int testY = originY + eyeY * distanceToWall;
+
+        // test if ray is out of boundary
+        if (!map.inBounds(testX, testY))
+        {
+            hit.distance = depth;
+            return hit;
+        }
+
+        hit.steps++;
+        if (map.isWall(testX, testY))
+        {
+            hit.hit = true;
+            hit.distance = distanceToWall;
+            hit.cellX = testX;
+            hit.cellY = testY;
+
+            // the step overshoots the wall, so guess the face from where
+            // the sample point sits relative to the centre of the cell
+            float hitX = originX + eyeX * distanceToWall;
+            float hitY = originY + eyeY * distanceToWall;
+            float dx = hitX - (testX + 0.5f);
+            float dy = hitY - (testY + 0.5f);
+            if (fabs(dx) > fabs(dy))
+            {
+                hit.face = dx < 0 ? WallFace::West : WallFace::East;
+                hit.wallX = hitY - testY;
+            }
+            else
+            {
+                hit.face = dy < 0 ? WallFace::North : WallFace::South;
+                hit.wallX = hitX - testX;
+            }
+            return hit;
+        }
+    }
+
+    hit.distance = depth;
+    return hit;
+}
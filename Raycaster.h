@@ -0,0 +1,107 @@
+#pragma once
+#include "DistanceField.h"
+#include "WallMap.h"
+
+// Which side of the wall cell the ray entered through.
+// North is the side facing smaller y (the top of the map).
+enum class WallFace
+{
+    None,
+    North,
+    East,
+    South,
+    West
+};
+
+struct RayHit
+{
+    float distance = 0.0f;          // distance along the ray to the hit point
+    int cellX = -1;                 // wall cell that was hit (-1 if none)
+    int cellY = -1;
+    WallFace face = WallFace::None;
+    float wallX = 0.0f;             // texture coordinate along the hit face [0, 1)
+    bool hit = false;               // false if the ray left the map or ran out of depth
+    int steps = 0;                  // map lookups done to find the hit
+};
+
+class Raycaster
+{
+public:
+    enum class Mode
+    {
+        DDA,        // visit every grid cell the ray crosses exactly once
+        Legacy,     // march forward in fixed steps of legacyStep
+        Field       // DDA that leaps across open space using the distance field
+    };
+
+    // How castPacket traces its rays in DDA mode
+    enum class Kernel
+    {
+        Scalar,     // one ray after another
+        SSE,        // 4 rays per lane group
+        AVX2        // 8 rays per lane group
+    };
+    static const int MaxPacket = 8;
+    // A camera on a grid line next to a wall hits it at distance 0; hits
+    // are reported at least this far away so the projection stays finite
+    static constexpr float MinHitDistance = 1e-3f;
+
+    Raycaster();
+
+    RayHit cast(const WallMap &map,
+                float originX, float originY, float eyeX, float eyeY, float depth) const;
+
+    // Trace count (at most MaxPacket) rays that share an origin, such as
+    // neighbouring screen columns. The SIMD kernels step all rays together
+    // and give the same hits as cast() one ray at a time.
+    void castPacket(const WallMap &map,
+                    float originX, float originY, const float *eyeX, const float *eyeY, int count,
+                    float depth, RayHit *hits) const;
+
+    // True if the ray passes within the edge threshold (an angle in radians,
+    // seen from the origin) of one of the two nearest corners of the hit
+    // cell. Used to darken the seams between wall tiles.
+    bool isTileEdge(const RayHit &hit, float originX, float originY, float eyeX, float eyeY) const;
+
+    float edgeThreshold() const { return m_edgeThreshold; }
+    void setEdgeThreshold(float radians);
+
+    Mode mode() const { return m_mode; }
+    void setMode(Mode mode) { m_mode = mode; }
+    static const char *modeName(Mode mode);
+
+    // Distance field of the map for Field mode, not owned by the raycaster.
+    // Field mode casts like DDA while there is none or it does not match
+    // the map's size.
+    void setDistanceField(const DistanceField *field) { m_field = field; }
+    const DistanceField *distanceField() const { return m_field; }
+
+    // Fill in the face and texture coordinate of a DDA hit, shared by the
+    // scalar and SIMD kernels so that they agree exactly
+    static void finishHit(RayHit &hit, bool crossedX, int stepX, int stepY,
+                          float originX, float originY, float eyeX, float eyeY);
+
+    Kernel kernel() const { return m_kernel; }
+    // Falls back to the best kernel this CPU supports if it lacks the one asked for
+    void setKernel(Kernel kernel);
+    static bool kernelSupported(Kernel kernel);
+    static Kernel bestKernel();
+    static const char *kernelName(Kernel kernel);
+
+private:
+    RayHit castDDA(const WallMap &map,
+                   float originX, float originY, float eyeX, float eyeY, float depth) const;
+    RayHit castField(const WallMap &map, const DistanceField &field,
+                     float originX, float originY, float eyeX, float eyeY, float depth) const;
+    RayHit castLegacy(const WallMap &map,
+                      float originX, float originY, float eyeX, float eyeY, float depth) const;
+
+
+private:
+    Mode m_mode = Mode::DDA;
+    const DistanceField *m_field = nullptr;
+    Kernel m_kernel = Kernel::Scalar;
+    float m_legacyStep = 0.1f;
+    float m_edgeThreshold = 0.005f;
+    float m_edgeSinSq = 0.005f * 0.005f;
+};
@@ -0,0 +1,287 @@
+// Packet DDA: trace several rays from the same origin in lock step, one
+// ray per SIMD lane. Every lane does exactly the float operations of
+// Raycaster::castDDA in the same order, so the hits match the scalar path.
+#include "Raycaster.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RAYCASTER_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+Raycaster::Raycaster()
+    : m_kernel(bestKernel())
+{
+}
+
+bool Raycaster::kernelSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::Scalar:
+        return true;
+#ifdef RAYCASTER_X86
+    case Kernel::SSE:
+        return __builtin_cpu_supports("sse2");
+    case Kernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+Raycaster::Kernel Raycaster::bestKernel()
+{
+    if (kernelSupported(Kernel::AVX2))
+        return Kernel::AVX2;
+    if (kernelSupported(Kernel::SSE))
+        return Kernel::SSE;
+    return Kernel::Scalar;
+}
+
+void Raycaster::setKernel(Kernel kernel)
+{
+    m_kernel = kernelSupported(kernel) ? kernel : bestKernel();
+}
+
+const char *Raycaster::kernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::Scalar:    return "SCALAR";
+    case Kernel::SSE:       return "SSE";
+    case Kernel::AVX2:      return "AVX2";
+    }
+    return "?";
+}
+
+// Per lane state that is written out of the vector registers when a lane
+// needs scalar work: the map lookup and finishing a hit
+struct PacketLanes
+{
+    int mapX[Raycaster::MaxPacket];
+    int mapY[Raycaster::MaxPacket];
+    float distance[Raycaster::MaxPacket];
+    int crossedX[Raycaster::MaxPacket];
+};
+
+#ifdef RAYCASTER_X86
+
+static void castPacketSSE(const WallMap &map,
+                          float originX, float originY, const float *eyeX, const float *eyeY, int count,
+                          float depth, RayHit *hits)
+{
+    int startX = (int)floor(originX);
+    int startY = (int)floor(originY);
+
+    // unused lanes copy lane 0 and are never active
+    float laneEyeX[4], laneEyeY[4];
+    for (int i = 0; i < 4; i++)
+    {
+        laneEyeX[i] = eyeX[i < count ? i : 0];
+        laneEyeY[i] = eyeY[i < count ? i : 0];
+    }
+    __m128 eyeXs = _mm_loadu_ps(laneEyeX);
+    __m128 eyeYs = _mm_loadu_ps(laneEyeY);
+
+    // |1 / eye| is infinite for an axis aligned ray, just like the scalar path
+    __m128 signBit = _mm_set1_ps(-0.0f);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 deltaX = _mm_andnot_ps(signBit, _mm_div_ps(one, eyeXs));
+    __m128 deltaY = _mm_andnot_ps(signBit, _mm_div_ps(one, eyeYs));
+
+    __m128 negX = _mm_cmplt_ps(eyeXs, _mm_setzero_ps());
+    __m128 negY = _mm_cmplt_ps(eyeYs, _mm_setzero_ps());
+    __m128i plusOne = _mm_set1_epi32(1);
+    __m128i stepX = _mm_or_si128(_mm_castps_si128(negX), _mm_andnot_si128(_mm_castps_si128(negX), plusOne));
+    __m128i stepY = _mm_or_si128(_mm_castps_si128(negY), _mm_andnot_si128(_mm_castps_si128(negY), plusOne));
+
+    auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+    __m128 sideX = _mm_mul_ps(select(negX, _mm_set1_ps(originX - startX), _mm_set1_ps(startX + 1.0f - originX)), deltaX);
+    __m128 sideY = _mm_mul_ps(select(negY, _mm_set1_ps(originY - startY), _mm_set1_ps(startY + 1.0f - originY)), deltaY);
+
+    __m128i mapX = _mm_set1_epi32(startX);
+    __m128i mapY = _mm_set1_epi32(startY);
+    __m128i lastX = _mm_set1_epi32(map.width() - 1);
+    __m128i lastY = _mm_set1_epi32(map.height() - 1);
+    __m128i zero = _mm_setzero_si128();
+    __m128 depths = _mm_set1_ps(depth);
+
+    int steps[4] = { 0, 0, 0, 0 };
+    int active = (1 << count) - 1;
+    PacketLanes lanes;
+    while (active)
+    {
+        // step every lane into whichever neighbouring cell its ray reaches first
+        __m128 crossedX = _mm_cmplt_ps(sideX, sideY);
+        __m128 distance = select(crossedX, sideX, sideY);
+        sideX = _mm_add_ps(sideX, _mm_and_ps(crossedX, deltaX));
+        sideY = _mm_add_ps(sideY, _mm_andnot_ps(crossedX, deltaY));
+        mapX = _mm_add_epi32(mapX, _mm_and_si128(_mm_castps_si128(crossedX), stepX));
+        mapY = _mm_add_epi32(mapY, _mm_andnot_si128(_mm_castps_si128(crossedX), stepY));
+
+        // lanes out of depth or outside the map finish without a hit
+        __m128i outside = _mm_or_si128(
+            _mm_or_si128(_mm_cmplt_epi32(mapX, zero), _mm_cmpgt_epi32(mapX, lastX)),
+            _mm_or_si128(_mm_cmplt_epi32(mapY, zero), _mm_cmpgt_epi32(mapY, lastY)));
+        __m128 done = _mm_or_ps(_mm_cmpge_ps(distance, depths), _mm_castsi128_ps(outside));
+        int missed = _mm_movemask_ps(done) & active;
+        for (int lane = missed; lane; lane &= lane - 1)
+        {
+            int i = __builtin_ctz(lane);
+            hits[i] = RayHit();
+            hits[i].distance = depth;
+            hits[i].steps = steps[i];
+        }
+        active &= ~missed;
+        if (!active)
+            break;
+
+        _mm_storeu_si128((__m128i *)lanes.mapX, mapX);
+        _mm_storeu_si128((__m128i *)lanes.mapY, mapY);
+        _mm_storeu_ps(lanes.distance, distance);
+        _mm_storeu_si128((__m128i *)lanes.crossedX, _mm_castps_si128(crossedX));
+        for (int lane = active; lane; lane &= lane - 1)
+        {
+            int i = __builtin_ctz(lane);
+            steps[i]++;
+            if (map.isWall(lanes.mapX[i], lanes.mapY[i]))
+            {
+                RayHit &hit = hits[i];
+                hit = RayHit();
+                hit.hit = true;
+                hit.distance = lanes.distance[i];
+                hit.cellX = lanes.mapX[i];
+                hit.cellY = lanes.mapY[i];
+                hit.steps = steps[i];
+                Raycaster::finishHit(hit, lanes.crossedX[i] != 0, eyeX[i] < 0 ? -1 : 1, eyeY[i] < 0 ? -1 : 1,
+                                     originX, originY, eyeX[i], eyeY[i]);
+                active &= ~(1 << i);
+            }
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void castPacketAVX2(const WallMap &map,
+                           float originX, float originY, const float *eyeX, const float *eyeY, int count,
+                           float depth, RayHit *hits)
+{
+    int startX = (int)floor(originX);
+    int startY = (int)floor(originY);
+
+    // unused lanes copy lane 0 and are never active
+    float laneEyeX[8], laneEyeY[8];
+    for (int i = 0; i < 8; i++)
+    {
+        laneEyeX[i] = eyeX[i < count ? i : 0];
+        laneEyeY[i] = eyeY[i < count ? i : 0];
+    }
+    __m256 eyeXs = _mm256_loadu_ps(laneEyeX);
+    __m256 eyeYs = _mm256_loadu_ps(laneEyeY);
+
+    // |1 / eye| is infinite for an axis aligned ray, just like the scalar path
+    __m256 signBit = _mm256_set1_ps(-0.0f);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 deltaX = _mm256_andnot_ps(signBit, _mm256_div_ps(one, eyeXs));
+    __m256 deltaY = _mm256_andnot_ps(signBit, _mm256_div_ps(one, eyeYs));
+
+    __m256 negX = _mm256_cmp_ps(eyeXs, _mm256_setzero_ps(), _CMP_LT_OQ);
+    __m256 negY = _mm256_cmp_ps(eyeYs, _mm256_setzero_ps(), _CMP_LT_OQ);
+    __m256i plusOne = _mm256_set1_epi32(1);
+    __m256i stepX = _mm256_blendv_epi8(plusOne, _mm256_castps_si256(negX), _mm256_castps_si256(negX));
+    __m256i stepY = _mm256_blendv_epi8(plusOne, _mm256_castps_si256(negY), _mm256_castps_si256(negY));
+
+    __m256 sideX = _mm256_mul_ps(_mm256_blendv_ps(_mm256_set1_ps(startX + 1.0f - originX), _mm256_set1_ps(originX - startX), negX), deltaX);
+    __m256 sideY = _mm256_mul_ps(_mm256_blendv_ps(_mm256_set1_ps(startY + 1.0f - originY), _mm256_set1_ps(originY - startY), negY), deltaY);
+
+    __m256i mapX = _mm256_set1_epi32(startX);
+    __m256i mapY = _mm256_set1_epi32(startY);
+    __m256i lastX = _mm256_set1_epi32(map.width() - 1);
+    __m256i lastY = _mm256_set1_epi32(map.height() - 1);
+    __m256i zero = _mm256_setzero_si256();
+    __m256 depths = _mm256_set1_ps(depth);
+
+    int steps[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    int active = (1 << count) - 1;
+    PacketLanes lanes;
+    while (active)
+    {
+        // step every lane into whichever neighbouring cell its ray reaches first
+        __m256 crossedX = _mm256_cmp_ps(sideX, sideY, _CMP_LT_OQ);
+        __m256 distance = _mm256_blendv_ps(sideY, sideX, crossedX);
+        sideX = _mm256_add_ps(sideX, _mm256_and_ps(crossedX, deltaX));
+        sideY = _mm256_add_ps(sideY, _mm256_andnot_ps(crossedX, deltaY));
+        mapX = _mm256_add_epi32(mapX, _mm256_and_si256(_mm256_castps_si256(crossedX), stepX));
+        mapY = _mm256_add_epi32(mapY, _mm256_andnot_si256(_mm256_castps_si256(crossedX), stepY));
+
+        // lanes out of depth or outside the map finish without a hit
+        __m256i outside = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi32(zero, mapX), _mm256_cmpgt_epi32(mapX, lastX)),
+            _mm256_or_si256(_mm256_cmpgt_epi32(zero, mapY), _mm256_cmpgt_epi32(mapY, lastY)));
+        __m256 done = _mm256_or_ps(_mm256_cmp_ps(distance, depths, _CMP_GE_OQ), _mm256_castsi256_ps(outside));
+        int missed = _mm256_movemask_ps(done) & active;
+        for (int lane = missed; lane; lane &= lane - 1)
+        {
+            int i = __builtin_ctz(lane);
+            hits[i] = RayHit();
+            hits[i].distance = depth;
+            hits[i].steps = steps[i];
+        }
+        active &= ~missed;
+        if (!active)
+            break;
+
+        _mm256_storeu_si256((__m256i *)lanes.mapX, mapX);
+        _mm256_storeu_si256((__m256i *)lanes.mapY, mapY);
+        _mm256_storeu_ps(lanes.distance, distance);
+        _mm256_storeu_si256((__m256i *)lanes.crossedX, _mm256_castps_si256(crossedX));
+        for (int lane = active; lane; lane &= lane - 1)
+        {
+            int i = __builtin_ctz(lane);
+            steps[i]++;
+            if (map.isWall(lanes.mapX[i], lanes.mapY[i]))
+            {
+                RayHit &hit = hits[i];
+                hit = RayHit();
+                hit.hit = true;
+                hit.distance = lanes.distance[i];
+                hit.cellX = lanes.mapX[i];
+                hit.cellY = lanes.mapY[i];
+                hit.steps = steps[i];
+                Raycaster::finishHit(hit, lanes.crossedX[i] != 0, eyeX[i] < 0 ? -1 : 1, eyeY[i] < 0 ? -1 : 1,
+                                     originX, originY, eyeX[i], eyeY[i]);
+                active &= ~(1 << i);
+            }
+        }
+    }
+}
+
+#endif
+
+void Raycaster::castPacket(const WallMap &map,
+                           float originX, float originY, const float *eyeX, const float *eyeY, int count,
+                           float depth, RayHit *hits) const
+{
+#ifdef RAYCASTER_X86
+    if (m_mode == Mode::DDA && m_kernel == Kernel::AVX2)
+    {
+        castPacketAVX2(map, originX, originY, eyeX, eyeY, count, depth, hits);
+        return;
+    }
+    if (m_mode == Mode::DDA && m_kernel == Kernel::SSE)
+    {
+        for (int i = 0; i < count; i += 4)
+        {
+            int lanes = count - i < 4 ? count - i : 4;
+            castPacketSSE(map, originX, originY, eyeX + i, eyeY + i, lanes, depth, hits + i);
+        }
+        return;
+    }
+#endif
+    for (int i = 0; i < count; i++)
+        hits[i] = cast(map, originX, originY, eyeX[i], eyeY[i], depth);
+}
@@ -0,0 +1,209 @@
+#include "RenderProtocol.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+static bool socketAddress(const string &path, sockaddr_un &address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+        return false;
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+int Connection::listenOn(const string &path)
+{
+    sockaddr_un address;
+    if (!socketAddress(path, address))
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr *)&address, sizeof(address)) < 0 || ::listen(fd, 64) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int Connection::connectTo(const string &path)
+{
+    sockaddr_un address;
+    if (!socketAddress(path, address))
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+Connection::Connection(int fd) : m_fd(fd)
+{
+    if (fd >= 0)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+Connection::~Connection()
+{
+    close();
+}
+
+void Connection::close()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+}
+
+void Connection::send(MessageType type, const void *payload, size_t length)
+{
+    MessageHeader header = { (uint32_t)type, (uint32_t)length };
+    m_output.append((const char *)&header, sizeof(header));
+    m_output.append((const char *)payload, length);
+}
+
+bool Connection::flush()
+{
+    while (!m_broken && hasOutput())
+    {
+        ssize_t written = ::send(m_fd, m_output.data() + m_outputSent, m_output.size() - m_outputSent, MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            m_broken = true;
+            break;
+        }
+        m_outputSent += written;
+    }
+    if (!hasOutput())
+    {
+        m_output.clear();
+        m_outputSent = 0;
+    }
+    return !m_broken;
+}
+
+bool Connection::receive()
+{
+    // drop what was handed out before reading more
+    if (m_inputRead > 0)
+    {
+        m_input.erase(0, m_inputRead);
+        m_inputRead = 0;
+    }
+    char buffer[65536];
+    while (!m_broken)
+    {
+        ssize_t count = read(m_fd, buffer, sizeof(buffer));
+        if (count > 0)
+        {
+            m_input.append(buffer, count);
+            continue;
+        }
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        m_broken = true;
+    }
+    return !m_broken;
+}
+
+bool Connection::nextMessage(MessageType &type, string &payload)
+{
+    MessageHeader header;
+    if (m_input.size() - m_inputRead < sizeof(header))
+        return false;
+    memcpy(&header, m_input.data() + m_inputRead, sizeof(header));
+    if (header.length > MaxMessage)
+    {
+        m_broken = true;
+        return false;
+    }
+    if (m_input.size() - m_inputRead < sizeof(header) + header.length)
+        return false;
+    type = (MessageType)header.type;
+    payload.assign(m_input, m_inputRead + sizeof(header), header.length);
+    m_inputRead += sizeof(header) + header.length;
+    return true;
+}
+
+string Connection::encodeFrame(FrameBuffer &frame, uint32_t number)
+{
+    string payload(sizeof(FrameMessage), '\0');
+    uint32_t runCount = 0;
+    for (int y = 0; y < frame.height(); y++)
+    {
+        int begin, end = 0;
+        while (frame.nextChangedRun(y, end, begin, end))
+        {
+            RunHeader run = { (uint16_t)y, (uint16_t)begin, (uint16_t)(end - begin) };
+            payload.append((const char *)&run, sizeof(run));
+            const Cell *cells = frame.row(y);
+            for (int x = begin; x < end; x++)
+            {
+                uint32_t ch = cells[x].ch;
+                payload.append((const char *)&ch, sizeof(ch));
+                payload.append((const char *)&cells[x].colorPair, sizeof(cells[x].colorPair));
+            }
+            runCount++;
+        }
+    }
+    FrameMessage message = { number, frame.width(), frame.height(), runCount };
+    memcpy(&payload[0], &message, sizeof(message));
+    frame.markPresented();
+    return payload;
+}
+
+bool Connection::decodeFrame(const string &payload, FrameBuffer &frame, uint32_t &number)
+{
+    FrameMessage message;
+    if (payload.size() < sizeof(message))
+        return false;
+    memcpy(&message, payload.data(), sizeof(message));
+    if (message.width <= 0 || message.height <= 0 || message.width > 0xffff || message.height > 0xffff)
+        return false;
+    frame.resize(message.width, message.height);
+    number = message.frame;
+
+    size_t offset = sizeof(message);
+    for (uint32_t i = 0; i < message.runCount; i++)
+    {
+        RunHeader run;
+        if (payload.size() - offset < sizeof(run))
+            return false;
+        memcpy(&run, payload.data() + offset, sizeof(run));
+        offset += sizeof(run);
+        if (run.y >= message.height || run.begin + run.count > message.width
+            || payload.size() - offset < (size_t)run.count * CellBytes)
+            return false;
+        for (int x = run.begin; x < run.begin + run.count; x++)
+        {
+            uint32_t ch;
+            short colorPair;
+            memcpy(&ch, payload.data() + offset, sizeof(ch));
+            memcpy(&colorPair, payload.data() + offset + sizeof(ch), sizeof(colorPair));
+            offset += CellBytes;
+            frame.set(x, run.y, (wchar_t)ch, colorPair);
+        }
+    }
+    return offset == payload.size();
+}
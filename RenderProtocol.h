@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "FrameBuffer.h"
+
+// Messages between the render server and its clients over a local Unix
+// domain socket. Every message is a MessageHeader followed by length bytes
+// of payload. Both ends are on the same machine, so everything is in the
+// host's byte order.
+enum class MessageType : uint32_t
+{
+    Hello,      // client to server, HelloMessage: the frame size it wants
+    Key,        // client to server, KeyMessage: a key was pressed
+    Ack,        // client to server, AckMessage: a frame has been drawn
+    Frame       // server to client, FrameMessage and the cells that changed
+};
+
+struct MessageHeader
+{
+    uint32_t type;
+    uint32_t length;
+};
+
+struct HelloMessage
+{
+    int32_t width;
+    int32_t height;
+};
+
+struct KeyMessage
+{
+    int32_t key;
+};
+
+struct AckMessage
+{
+    uint32_t frame;
+};
+
+// Followed by runCount runs, each a RunHeader and count cells of
+// CellBytes: the character, then the colour pair
+struct FrameMessage
+{
+    uint32_t frame;
+    int32_t width;
+    int32_t height;
+    uint32_t runCount;
+};
+
+struct RunHeader
+{
+    uint16_t y;
+    uint16_t begin;
+    uint16_t count;
+};
+
+// One end of a socket carrying messages. Reading and writing never block:
+// receive() takes whatever has arrived and nextMessage() hands out the
+// complete messages, send() queues and flush() writes as much as the
+// socket takes, so one thread can serve many connections with poll().
+class Connection
+{
+public:
+    static const size_t MaxMessage = 16 << 20;     // longer messages close the connection
+    static const int CellBytes = 6;
+
+    explicit Connection(int fd = -1);
+    ~Connection();
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+    // Socket listening on path, replacing a stale socket file, or -1
+    static int listenOn(const std::string &path);
+    // Socket connected to the server on path, or -1
+    static int connectTo(const std::string &path);
+
+    int fd() const { return m_fd; }
+    bool isOpen() const { return m_fd >= 0; }
+    // the peer hung up, the socket failed or a message was too long
+    bool broken() const { return m_broken; }
+    void close();
+
+    void send(MessageType type, const void *payload, size_t length);
+    // write queued messages until the socket is full, false if it broke
+    bool flush();
+    bool hasOutput() const { return m_outputSent < m_output.size(); }
+    size_t queuedBytes() const { return m_output.size() - m_outputSent; }
+
+    // read what has arrived, false on end of file or an error
+    bool receive();
+    // take the next complete message, false if there is none yet
+    bool nextMessage(MessageType &type, std::string &payload);
+
+    // Frame message payload with the cells of frame that differ from what
+    // was last presented, all of them if nothing was, and mark the frame
+    // presented. An unchanged frame gives no runs.
+    static std::string encodeFrame(FrameBuffer &frame, uint32_t number);
+    // Apply a frame message to frame, resizing it to the sender's size,
+    // false if the payload is malformed
+    static bool decodeFrame(const std::string &payload, FrameBuffer &frame, uint32_t &number);
+
+private:
+    int m_fd;
+    std::string m_input;
+    size_t m_inputRead = 0;         // bytes of m_input already handed out
+    std::string m_output;
+    size_t m_outputSent = 0;
+    bool m_broken = false;
+};
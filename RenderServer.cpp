@@ -0,0 +1,280 @@
+#include "RenderServer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+RenderServer::RenderServer(int threads) : m_threadPool(threads)
+{
+}
+
+RenderServer::~RenderServer()
+{
+    m_clients.clear();
+    if (m_listenFd >= 0)
+    {
+        close(m_listenFd);
+        unlink(m_socketPath.c_str());
+    }
+}
+
+bool RenderServer::listen(const string &socketPath)
+{
+    m_listenFd = Connection::listenOn(socketPath);
+    m_socketPath = socketPath;
+    return m_listenFd >= 0;
+}
+
+void RenderServer::acceptClients()
+{
+    for (;;)
+    {
+        int fd = accept(m_listenFd, nullptr, nullptr);
+        if (fd < 0)
+            return;
+        m_clients.emplace_back(new Client(fd));
+        spawn(*m_clients.back());
+    }
+}
+
+void RenderServer::spawn(Client &client)
+{
+    client.renderer.setThreadPool(&m_threadPool);
+    client.renderer.setColumnCache(true);
+    client.renderer.setEntities(&client.others);
+    // a random floor cell, the map corner if the map is nearly all wall
+    client.camera.x = client.camera.y = 1.5f;
+    for (int attempt = 0; attempt < 1000 && m_map.width() > 0; attempt++)
+    {
+        int x = m_random.below(m_map.width());
+        int y = m_random.below(m_map.height());
+        if (!m_map.isWall(x, y))
+        {
+            client.camera.x = x + 0.5f;
+            client.camera.y = y + 0.5f;
+            break;
+        }
+    }
+    client.camera.angle = m_random.unit() * 2.0f * 3.14159265f;
+    m_worldVersion++;
+}
+
+bool RenderServer::readClient(Client &client, chrono::steady_clock::time_point now)
+{
+    if (!client.connection.receive())
+        return false;
+    auto holdUntil = now + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<float>(m_keyHoldTime));
+    MessageType type;
+    string payload;
+    while (client.connection.nextMessage(type, payload))
+    {
+        switch (type)
+        {
+        case MessageType::Hello:
+        {
+            HelloMessage hello;
+            if (payload.size() != sizeof(hello))
+                return false;
+            memcpy(&hello, payload.data(), sizeof(hello));
+            client.frame.resize(clamp(hello.width, 3, 1000), clamp(hello.height, 3, 1000));
+            client.frame.invalidate();
+            client.greeted = true;
+            client.renderedVersion = 0;
+            break;
+        }
+        case MessageType::Key:
+        {
+            KeyMessage key;
+            if (payload.size() != sizeof(key))
+                return false;
+            memcpy(&key, payload.data(), sizeof(key));
+            switch (key.key)
+            {
+            case 'a': case 'A': client.heldUntil[ACTION_TURN_LEFT] = holdUntil; break;
+            case 'd': case 'D': client.heldUntil[ACTION_TURN_RIGHT] = holdUntil; break;
+            case 'w': case 'W': client.heldUntil[ACTION_FORWARD] = holdUntil; break;
+            case 's': case 'S': client.heldUntil[ACTION_BACKWARD] = holdUntil; break;
+            }
+            break;
+        }
+        case MessageType::Ack:
+        {
+            AckMessage ack;
+            if (payload.size() != sizeof(ack))
+                return false;
+            memcpy(&ack, payload.data(), sizeof(ack));
+            if (ack.frame == client.frameNumber)
+                client.waitingForAck = false;
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return !client.connection.broken();
+}
+
+void RenderServer::movePlayers(float seconds, chrono::steady_clock::time_point now)
+{
+    for (auto &client : m_clients)
+    {
+        auto held = [&](Action action) { return client->heldUntil[action] > now; };
+        Camera &camera = client->camera;
+        float oldX = camera.x, oldY = camera.y, oldAngle = camera.angle;
+
+        if (held(ACTION_TURN_LEFT))
+            camera.angle -= m_rotateSpeed * seconds;
+        if (held(ACTION_TURN_RIGHT))
+            camera.angle += m_rotateSpeed * seconds;
+        float move = 0.0f;
+        if (held(ACTION_FORWARD))
+            move += m_moveSpeed * seconds;
+        if (held(ACTION_BACKWARD))
+            move -= m_moveSpeed * seconds;
+        if (move != 0.0f)
+        {
+            float x = camera.x + sin(camera.angle) * move;
+            float y = camera.y + cos(camera.angle) * move;
+            // wall collision, as in the game
+            if (x >= 0 && y >= 0 && m_map.inBounds((int)x, (int)y) && !m_map.isWall((int)x, (int)y))
+            {
+                camera.x = x;
+                camera.y = y;
+            }
+        }
+        if (camera.x != oldX || camera.y != oldY || camera.angle != oldAngle)
+            m_worldVersion++;
+    }
+}
+
+void RenderServer::renderClient(Client &client)
+{
+    // the other players as seen by this one
+    client.others.clear();
+    for (const auto &other : m_clients)
+        if (other.get() != &client)
+            client.others.add(other->camera.x, other->camera.y, EntityLayer::Npc);
+    client.renderer.render(client.camera, m_map, m_depth, client.frame);
+    client.payload = Connection::encodeFrame(client.frame, client.frameNumber + 1);
+    client.renderedVersion = m_worldVersion;
+}
+
+void RenderServer::run(float tickRate, const volatile sig_atomic_t &stop, float reportSeconds)
+{
+    using Clock = chrono::steady_clock;
+    auto interval = chrono::duration_cast<Clock::duration>(chrono::duration<float>(1.0f / tickRate));
+    auto lastTick = Clock::now();
+    auto nextTick = lastTick;
+    auto lastReport = lastTick;
+    vector<pollfd> fds;
+    vector<Client *> ready;
+
+    while (!stop)
+    {
+        // between ticks take in key presses and acks as they arrive, and
+        // send what the sockets would not take at once
+        auto now = Clock::now();
+        if (now < nextTick)
+        {
+            fds.clear();
+            fds.push_back({ m_listenFd, POLLIN, 0 });
+            for (const auto &client : m_clients)
+                fds.push_back({ client->connection.fd(),
+                                (short)(POLLIN | (client->connection.hasOutput() ? POLLOUT : 0)), 0 });
+            int timeoutMs = (int)ceil(chrono::duration<double, milli>(nextTick - now).count());
+            if (poll(fds.data(), fds.size(), timeoutMs) < 0 && errno != EINTR)
+                break;
+
+            now = Clock::now();
+            size_t clientCount = m_clients.size();
+            for (size_t i = 0; i < clientCount; i++)
+            {
+                Client &client = *m_clients[i];
+                short events = fds[i + 1].revents;
+                bool alive = true;
+                if (events & (POLLIN | POLLHUP | POLLERR))
+                    alive = readClient(client, now);
+                if (alive && (events & POLLOUT))
+                    alive = client.connection.flush();
+                if (!alive)
+                    client.connection.close();
+            }
+            size_t before = m_clients.size();
+            m_clients.erase(remove_if(m_clients.begin(), m_clients.end(),
+                                      [](const unique_ptr<Client> &client) { return !client->connection.isOpen(); }),
+                            m_clients.end());
+            if (m_clients.size() != before)
+                m_worldVersion++;
+            if (fds[0].revents & POLLIN)
+                acceptClients();
+            continue;
+        }
+
+        auto tickStart = now;
+        movePlayers(chrono::duration<float>(now - lastTick).count(), now);
+        lastTick = now;
+
+        // render the clients that are ready for a frame and whose view may
+        // have changed, one client per task. A lone client is split by
+        // columns instead.
+        ready.clear();
+        for (const auto &client : m_clients)
+            if (client->greeted && !client->waitingForAck && client->renderedVersion != m_worldVersion)
+                ready.push_back(client.get());
+        if (ready.size() == 1)
+            renderClient(*ready[0]);
+        else if (!ready.empty())
+            m_threadPool.parallelFor(0, ready.size(), 1, [&](int begin, int end)
+            {
+                for (int i = begin; i < end; i++)
+                    renderClient(*ready[i]);
+            });
+        m_stats.renderSeconds += chrono::duration<double>(Clock::now() - tickStart).count();
+
+        for (Client *client : ready)
+        {
+            // a view that did not change still gets its (empty) frame, so
+            // clients see the frame rate they are served at
+            client->frameNumber++;
+            client->connection.send(MessageType::Frame, client->payload.data(), client->payload.size());
+            client->waitingForAck = true;
+            m_stats.frames++;
+            m_stats.bytes += client->payload.size();
+            if (!client->connection.flush())
+                client->connection.close();
+        }
+
+        now = Clock::now();
+        m_stats.ticks++;
+        if (now - tickStart > interval)
+            m_stats.lateTicks++;
+        nextTick = max(nextTick + interval, now);
+
+        float sinceReport = chrono::duration<float>(now - lastReport).count();
+        if (reportSeconds > 0 && sinceReport >= reportSeconds)
+        {
+            m_stats.clients = m_clients.size();
+            report(m_stats, sinceReport);
+            m_stats = Stats();
+            lastReport = now;
+        }
+    }
+}
+
+void RenderServer::report(Stats &stats, float seconds) const
+{
+    // the render share of the time says how many more clients would fit
+    double perClient = stats.clients > 0 ? stats.frames / seconds / stats.clients : 0;
+    printf("clients %4d  ticks/s %5.1f  late %3d  frames/s %7.1f (%5.1f per client)  "
+           "render %6.2f ms/tick (%3.0f%% busy)  %8.1f kB/s\n",
+           stats.clients, stats.ticks / seconds, stats.lateTicks, stats.frames / seconds, perClient,
+           stats.ticks > 0 ? stats.renderSeconds * 1000 / stats.ticks : 0, stats.renderSeconds / seconds * 100,
+           stats.bytes / seconds / 1024);
+    fflush(stdout);
+}
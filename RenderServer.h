@@ -0,0 +1,102 @@
+#pragma once
+#include <chrono>
+#include <csignal>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "EntityLayer.h"
+#include "FrameBuffer.h"
+#include "Random.h"
+#include "RenderProtocol.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+#include "WallMap.h"
+
+// One shared world served to many terminals. Clients connect over a Unix
+// domain socket, each one is a player in the world: it sends its key
+// presses and gets frames of its own view back, with the other players
+// drawn as entities.
+//
+// Every tick the players move, then the views of the clients that need a
+// new frame are rendered in parallel on the thread pool, one client per
+// task. A frame only carries the cells that changed since the last frame
+// the client acknowledged, and a client gets no new frame until it has
+// acknowledged the last one, so a slow client gets fewer frames instead
+// of a growing backlog, and never holds up the others.
+class RenderServer
+{
+public:
+    // Work done over the last report interval
+    struct Stats
+    {
+        int clients = 0;
+        int ticks = 0;
+        int lateTicks = 0;          // ticks that took longer than the tick interval
+        long frames = 0;            // frames sent
+        long bytes = 0;             // frame bytes sent
+        double renderSeconds = 0;   // time spent rendering and encoding frames
+    };
+
+    // threads 0 uses every core
+    explicit RenderServer(int threads = 0);
+    ~RenderServer();
+
+    // The world, to set up before run(). Players start on random floor cells.
+    WallMap &map() { return m_map; }
+    void setDepth(float depth) { m_depth = depth; }
+
+    bool listen(const std::string &socketPath);
+    // Serve tickRate ticks a second until stop is set, e.g. by a signal
+    // handler, printing the stats every reportSeconds (0 for never)
+    void run(float tickRate, const volatile std::sig_atomic_t &stop, float reportSeconds);
+
+private:
+    enum Action
+    {
+        ACTION_TURN_LEFT,
+        ACTION_TURN_RIGHT,
+        ACTION_FORWARD,
+        ACTION_BACKWARD,
+        ACTION_COUNT
+    };
+
+    struct Client
+    {
+        explicit Client(int fd) : connection(fd) {}
+
+        Connection connection;
+        Camera camera;                  // the player
+        std::chrono::steady_clock::time_point heldUntil[ACTION_COUNT] = {};
+        bool greeted = false;           // sent its frame size
+        bool waitingForAck = false;     // a frame is on its way
+        uint32_t frameNumber = 0;       // last frame sent
+        unsigned renderedVersion = 0;   // world version of the last frame
+        Renderer renderer;
+        FrameBuffer frame;
+        EntityLayer others;             // the other players
+        std::string payload;            // encoded frame waiting to be queued
+    };
+
+    void acceptClients();
+    // handle what the client sent, false if it hung up or broke the protocol
+    bool readClient(Client &client, std::chrono::steady_clock::time_point now);
+    void movePlayers(float seconds, std::chrono::steady_clock::time_point now);
+    void renderClient(Client &client);
+    void spawn(Client &client);
+    void report(Stats &stats, float seconds) const;
+
+private:
+    ThreadPool m_threadPool;
+    WallMap m_map;
+    float m_depth = 16.0f;
+    std::string m_socketPath;
+    int m_listenFd = -1;
+    std::vector<std::unique_ptr<Client>> m_clients;
+    unsigned m_worldVersion = 1;    // counts up whenever a player moves, joins or leaves
+    Random m_random;                // spawn cells
+    float m_keyHoldTime = 0.1f;     // seconds a key press keeps its action going
+    float m_moveSpeed = 5.0f;       // cells per second
+    float m_rotateSpeed = 2.0f;     // radians per second
+    Stats m_stats;
+};
@@ -0,0 +1,74 @@
+#include "RenderTables.h"
+#include <cmath>
+
+using namespace std;
+
+const wchar_t RenderTables::WallShades[5] = { ' ', 0x2591, 0x2592, 0x2593, 0x2588 };
+const wchar_t RenderTables::FloorShades[5] = { ' ', '-', '.', '~', '=' };
+
+RenderTables::RenderTables()
+{
+    // Shader walls based on distance
+    for (int bucket = 0; bucket <= WallBuckets; bucket++)
+    {
+        int shade;
+        if (bucket < WallBuckets / 4)           shade = 4;      // Very close
+        else if (bucket < WallBuckets / 3)      shade = 3;
+        else if (bucket < WallBuckets / 2)      shade = 2;
+        else if (bucket < WallBuckets)          shade = 1;
+        else                                    shade = 0;      // Too far away
+        m_wallShade[bucket] = shade;
+    }
+
+    // baked light, the ambient light of unlit cells gets the dimmest shade
+    for (int light = 0; light < 256; light++)
+    {
+        int shade;
+        if (light < 40)             shade = 0;
+        else if (light < 100)       shade = 1;
+        else if (light < 150)       shade = 2;
+        else if (light < 200)       shade = 3;
+        else                        shade = 4;
+        m_lightShade[light] = shade;
+    }
+}
+
+void RenderTables::update(int width, int height, float fov)
+{
+    if (width == m_width && height == m_height && fov == m_fov)
+        return;
+    m_width = width;
+    m_height = height;
+    m_fov = fov;
+
+    // angle of each column's ray from the middle of the view
+    m_columnSin.resize(width);
+    m_columnCos.resize(width);
+    for (int x = 0; x < width; x++)
+    {
+        float offset = -fov / 2 + ((float)x / (float)width) * fov;
+        m_columnSin[x] = sin(offset);
+        m_columnCos[x] = cos(offset);
+    }
+
+    // shade floor based on distance, darker towards the horizon
+    m_floorGlyph.resize(height);
+    m_floorShade.resize(height);
+    m_floorDistance.resize(height);
+    for (int y = 0; y < height; y++)
+    {
+        float b = 1.0f - (y - height / 2.0f) / (height / 2.0f);
+        int floorShade;
+        if(b < 0.25f)        floorShade = 4;
+        else if(b < 0.5f)    floorShade = 3;
+        else if(b < 0.75f)   floorShade = 2;
+        else if(b < 0.9f)    floorShade = 1;
+        else                 floorShade = 0;
+        m_floorShade[y] = floorShade;
+        m_floorGlyph[y] = FloorShades[floorShade];
+        // a wall at distance d ends on row height / 2 + height / d, so the
+        // floor on row y is as far away as a wall ending there. Rows above
+        // the horizon are never floor, they get a far but finite distance.
+        m_floorDistance[y] = y > height / 2.0f ? height / (y - height / 2.0f) : 1e6f;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Values the renderer needs for every frame that only depend on the size
+// of the frame and the field of view, built once and reused until one of
+// them changes:
+// - the direction of each column's ray relative to the camera, so the ray
+//   directions of a frame are a rotation of these instead of a sin and cos
+//   per column
+// - the floor glyph of each screen row
+// - the wall shade by distance, in buckets of the ray depth
+// - for lit maps, the shade of each baked light value and the distance
+//   along the ray to the floor seen on each screen row
+//
+// Walls and floor are drawn with five shades from dark to bright. On a
+// lit map a wall or floor cell gets the darker of the shade its distance
+// gives and the shade of its baked light.
+class RenderTables
+{
+public:
+    RenderTables();
+
+    // Rebuild the tables if the frame size or field of view changed
+    void update(int width, int height, float fov);
+
+    // Ray direction of column x for a camera looking along angle, given
+    // sin(angle) and cos(angle)
+    void rayDirection(int x, float sinAngle, float cosAngle, float &eyeX, float &eyeY) const
+    {
+        // (sin, cos) of angle + offset
+        eyeX = sinAngle * m_columnCos[x] + cosAngle * m_columnSin[x];
+        eyeY = cosAngle * m_columnCos[x] - sinAngle * m_columnSin[x];
+    }
+
+    wchar_t floorGlyph(int y) const { return m_floorGlyph[y]; }
+    wchar_t litFloorGlyph(int y, uint8_t light) const
+    {
+        return FloorShades[std::min(m_floorShade[y], m_lightShade[light])];
+    }
+    // distance along the ray to the floor drawn on row y, below the horizon
+    float floorDistance(int y) const { return m_floorDistance[y]; }
+
+    // Wall shade for a wall distance away with rays going up to depth,
+    // from 0 (black) to 4 (full block). Bucket boundaries fall exactly on
+    // the band edges (a quarter, a third and half of the depth).
+    int wallShade(float distance, float depth) const
+    {
+        float bucket = distance * (WallBuckets / depth);
+        return bucket < WallBuckets ? m_wallShade[(int)bucket] : 0;
+    }
+    // shade of a baked light value
+    int lightShade(uint8_t light) const { return m_lightShade[light]; }
+    static wchar_t wallShadeGlyph(int shade) { return WallShades[shade]; }
+
+private:
+    static const int WallBuckets = 240;
+    static const wchar_t WallShades[5];
+    static const wchar_t FloorShades[5];
+
+    int m_width = -1;
+    int m_height = -1;
+    float m_fov = 0.0f;
+    std::vector<float> m_columnSin;
+    std::vector<float> m_columnCos;
+    std::vector<wchar_t> m_floorGlyph;
+    std::vector<uint8_t> m_floorShade;
+    std::vector<float> m_floorDistance;
+    uint8_t m_wallShade[WallBuckets + 1];
+    uint8_t m_lightShade[256];
+};
@@ -0,0 +1,315 @@
+#include "Renderer.h"
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+void Renderer::render(const Camera &camera, const WallMap &map, float depth, FrameBuffer &frame)
+{
+    int screenWidth = frame.width();
+    m_tables.update(screenWidth, frame.height(), camera.fov);
+    m_depthBuffer.resize(screenWidth, depth);
+    selectColumns(camera, map, depth, frame);
+    const Camera &view = m_cacheValid ? m_cachedCamera : camera;
+
+    // every ray direction is a column's offset rotated by the camera angle
+    float sinAngle = sin(view.angle);
+    float cosAngle = cos(view.angle);
+    atomic<long> raySteps{0};
+    atomic<int> maxRaySteps{0};
+    atomic<int> wallHits{0};
+    atomic<long> castNanoseconds{0};
+    atomic<long> shadeNanoseconds{0};
+    const bool timing = m_timing;
+    const int *columns = m_columns.data();
+
+    // begin and end index m_columns, which are whole screen columns when
+    // nothing is cached
+    auto renderColumns = [&](int begin, int end)
+    {
+        // columns are traced together as one ray packet, neighbours when
+        // the whole screen is traced
+        float eyeX[Raycaster::MaxPacket];
+        float eyeY[Raycaster::MaxPacket];
+        RayHit hits[Raycaster::MaxPacket];
+        RenderStats stats;
+        chrono::steady_clock::duration castTime{0}, shadeTime{0};
+        chrono::steady_clock::time_point start, cast;
+        for (int i0 = begin; i0 < end; i0 += Raycaster::MaxPacket)
+        {
+            if (timing)
+                start = chrono::steady_clock::now();
+            int count = min(Raycaster::MaxPacket, end - i0);
+            for (int i = 0; i < count; i++)
+                m_tables.rayDirection(columns[i0 + i], sinAngle, cosAngle, eyeX[i], eyeY[i]);
+
+            m_raycaster.castPacket(map, view.x, view.y, eyeX, eyeY, count, depth, hits);
+            if (timing)
+                cast = chrono::steady_clock::now();
+            for (int i = 0; i < count; i++)
+            {
+                int x = columns[i0 + i];
+                stats.raySteps += hits[i].steps;
+                stats.maxRaySteps = max(stats.maxRaySteps, hits[i].steps);
+                stats.wallHits += hits[i].hit;
+                shadeColumn(x, hits[i], eyeX[i], eyeY[i], view, depth, frame);
+                m_depthBuffer[x] = hits[i].hit ? hits[i].distance : depth;
+                if (m_cacheValid)
+                {
+                    m_hits[x] = hits[i];
+                    m_stale[x] = 0;
+                }
+            }
+            if (timing)
+            {
+                auto shaded = chrono::steady_clock::now();
+                castTime += cast - start;
+                shadeTime += shaded - cast;
+            }
+        }
+        raySteps += stats.raySteps;
+        wallHits += stats.wallHits;
+        int longest = maxRaySteps;
+        while (stats.maxRaySteps > longest && !maxRaySteps.compare_exchange_weak(longest, stats.maxRaySteps))
+            ;
+        castNanoseconds += chrono::duration_cast<chrono::nanoseconds>(castTime).count();
+        shadeNanoseconds += chrono::duration_cast<chrono::nanoseconds>(shadeTime).count();
+    };
+
+    int columnCount = (int)m_columns.size();
+    if (m_threadPool && columnCount > 0)
+    {
+        // small chunks so that columns with long rays are spread across
+        // threads, rounded to whole ray packets
+        int grain = max(1, columnCount / (m_threadPool->threadCount() * 8));
+        grain = (grain + Raycaster::MaxPacket - 1) / Raycaster::MaxPacket * Raycaster::MaxPacket;
+        m_threadPool->parallelFor(0, columnCount, grain, renderColumns);
+    }
+    else
+    {
+        renderColumns(0, columnCount);
+    }
+
+    if (m_columnStep > 1)
+        fillColumnGaps(frame);
+
+    // Entities go over the finished walls. Columns they covered have to be
+    // shaded again next frame even when the camera does not move.
+    m_stats.entitiesConsidered = 0;
+    m_stats.entitiesDrawn = 0;
+    if (m_entities)
+    {
+        m_entities->draw(view, m_depthBuffer.data(), depth, frame, [&](int begin, int end)
+        {
+            if (m_cacheValid)
+                fill(m_stale.begin() + begin, m_stale.begin() + end, 1);
+        });
+        m_stats.entitiesConsidered = m_entities->stats().considered;
+        m_stats.entitiesDrawn = m_entities->stats().drawn;
+    }
+
+    m_stats.raySteps = raySteps;
+    m_stats.maxRaySteps = maxRaySteps;
+    m_stats.wallHits = wallHits;
+    m_stats.columnsTraced = columnCount;
+    m_stats.castSeconds = castNanoseconds * 1e-9;
+    m_stats.shadeSeconds = shadeNanoseconds * 1e-9;
+}
+
+void Renderer::fillColumnGaps(FrameBuffer &frame)
+{
+    int screenWidth = frame.width();
+    for (int y = 0; y < frame.height(); y++)
+    {
+        Cell *cells = frame.row(y);
+        for (int x = 0; x < screenWidth; x += m_columnStep)
+            fill(cells + x + 1, cells + min(x + m_columnStep, screenWidth), cells[x]);
+    }
+    for (int x = 0; x < screenWidth; x += m_columnStep)
+        fill(m_depthBuffer.begin() + x + 1, m_depthBuffer.begin() + min(x + m_columnStep, screenWidth),
+             m_depthBuffer[x]);
+}
+
+void Renderer::setColumnCache(bool enabled)
+{
+    m_columnCache = enabled;
+    m_cacheValid = false;
+}
+
+void Renderer::selectColumns(const Camera &camera, const WallMap &map, float depth, FrameBuffer &frame)
+{
+    int screenWidth = frame.width();
+    m_columns.clear();
+    if (!m_columnCache || m_columnStep > 1)
+    {
+        for (int x = 0; x < screenWidth; x += m_columnStep)
+            m_columns.push_back(x);
+        // the frame is not a picture of every column's hit any more
+        m_cacheValid = false;
+        return;
+    }
+
+    // Snap the angle to whole columns. Column x + k of a view turned by k
+    // columns looks along exactly the same ray as column x before, so the
+    // old hits and the shaded frame only have to be shifted.
+    float columnAngle = camera.fov / max(1, screenWidth);
+    long angleIndex = lround(camera.angle / columnAngle);
+
+    bool sameView = m_cacheValid && camera.x == m_cachedCamera.x && camera.y == m_cachedCamera.y &&
+                    camera.fov == m_cachedCamera.fov && depth == m_cachedDepth &&
+                    &map == m_cachedMap && &frame == m_cachedFrame &&
+                    screenWidth == m_cachedWidth && frame.height() == m_cachedHeight &&
+                    m_raycaster.mode() == m_cachedMode;
+    long shift = angleIndex - m_cachedAngleIndex;
+    if (!sameView || shift <= -screenWidth || shift >= screenWidth)
+    {
+        m_hits.assign(screenWidth, RayHit());
+        m_stale.assign(screenWidth, 1);
+    }
+    else if (shift != 0)
+    {
+        // new column x is old column x + shift, the columns that turned
+        // into view have to be traced
+        int k = (int)shift;
+        frame.scrollColumns(k);
+        if (k > 0)
+        {
+            copy(m_hits.begin() + k, m_hits.end(), m_hits.begin());
+            copy(m_stale.begin() + k, m_stale.end(), m_stale.begin());
+            copy(m_depthBuffer.begin() + k, m_depthBuffer.end(), m_depthBuffer.begin());
+            fill(m_stale.end() - k, m_stale.end(), 1);
+        }
+        else
+        {
+            copy_backward(m_hits.begin(), m_hits.end() + k, m_hits.end());
+            copy_backward(m_stale.begin(), m_stale.end() + k, m_stale.end());
+            copy_backward(m_depthBuffer.begin(), m_depthBuffer.end() + k, m_depthBuffer.end());
+            fill(m_stale.begin(), m_stale.begin() - k, 1);
+        }
+    }
+
+    m_cacheValid = true;
+    m_cachedCamera = camera;
+    m_cachedCamera.angle = angleIndex * columnAngle;
+    m_cachedAngleIndex = angleIndex;
+    m_cachedDepth = depth;
+    m_cachedMap = &map;
+    m_cachedFrame = &frame;
+    m_cachedWidth = screenWidth;
+    m_cachedHeight = frame.height();
+    m_cachedMode = m_raycaster.mode();
+
+    for (int x = 0; x < screenWidth; x++)
+        if (m_stale[x])
+            m_columns.push_back(x);
+}
+
+void Renderer::invalidateCell(int cellX, int cellY)
+{
+    if (!m_cacheValid)
+        return;
+    // Retrace every column whose ray, from the camera to its hit (or its
+    // full depth), passes through the cell: a slab test of the segment
+    // against the cell's box.
+    float sinAngle = sin(m_cachedCamera.angle);
+    float cosAngle = cos(m_cachedCamera.angle);
+    float originX = m_cachedCamera.x;
+    float originY = m_cachedCamera.y;
+    auto slab = [](float origin, float eye, float low, float high, float &enter, float &leave)
+    {
+        if (eye == 0.0f)
+            return origin >= low && origin <= high;
+        float t0 = (low - origin) / eye;
+        float t1 = (high - origin) / eye;
+        if (t0 > t1)
+            swap(t0, t1);
+        enter = max(enter, t0);
+        leave = min(leave, t1);
+        return enter <= leave;
+    };
+    for (int x = 0; x < m_cachedWidth; x++)
+    {
+        if (m_stale[x])
+            continue;
+        float eyeX, eyeY;
+        m_tables.rayDirection(x, sinAngle, cosAngle, eyeX, eyeY);
+        float enter = 0.0f;
+        // a little past the hit so that the hit cell itself always counts
+        float leave = (m_hits[x].hit ? m_hits[x].distance : m_cachedDepth) + 0.01f;
+        if (slab(originX, eyeX, cellX, cellX + 1.0f, enter, leave) &&
+            slab(originY, eyeY, cellY, cellY + 1.0f, enter, leave))
+            m_stale[x] = 1;
+    }
+}
+
+void Renderer::shadeColumn(int x, const RayHit &hit, float eyeX, float eyeY, const Camera &camera,
+                           float depth, FrameBuffer &frame) const
+{
+    int screenHeight = frame.height();
+    float distanceToWall = hit.distance;
+
+    // highlight tile boundaries where the ray grazes a corner of the hit face
+    bool isBoundary = m_raycaster.isTileEdge(hit, camera.x, camera.y, eyeX, eyeY);
+
+    // Calculate distance to celling and floor
+    int nCelling = screenHeight / 2.0f - screenHeight / distanceToWall;
+    int nFloor = screenHeight - nCelling;
+
+    // Shader walls based on distance, and the light baked into the face
+    bool lit = m_lightmap && !m_lightmap->empty();
+    int shade = m_tables.wallShade(distanceToWall, depth);
+    if (lit)
+        shade = min(shade, m_tables.lightShade(m_lightmap->faceLight(hit.cellX, hit.cellY, hit.face)));
+    if (isBoundary)		shade = 0; // Black it out
+
+    // ceiling, wall and floor spans, clipped to the screen
+    int wallBegin = max(0, min(nCelling, screenHeight));
+    int wallEnd = max(wallBegin, min(nFloor + 1, screenHeight));
+    int y = 0;
+    for (; y < wallBegin; ++y)
+        frame.set(x, y, ' ');
+    if (!m_atlas || shade == 0)
+    {
+        wchar_t nShade = RenderTables::wallShadeGlyph(shade);
+        for (; y < wallEnd; ++y)
+            frame.set(x, y, nShade);
+    }
+    else
+    {
+        // one column of the mip level that fits the slice, in the copy
+        // of the atlas for the wall's shade
+        int texture = m_textures ? m_textures->at(hit.cellX, hit.cellY) : 0;
+        if (texture >= TextureAtlas::TextureCount)
+            texture = 0;
+        // 64 bits, a wall right in front of the camera is millions of rows high
+        int64_t sliceHeight = (int64_t)nFloor - nCelling + 1;
+        int level = TextureAtlas::levelFor((int)min<int64_t>(sliceHeight, TextureAtlas::Size));
+        int size = TextureAtlas::Size >> level;
+        int u = min(size - 1, (int)(hit.wallX * size));
+        const Cell *column = m_atlas->column(texture, shade, level, u);
+        // texel row in 16.16 fixed point, one add per screen row
+        int64_t step = ((int64_t)size << 16) / sliceHeight;
+        int64_t position = (wallBegin - nCelling) * step;
+        for (; y < wallEnd; ++y, position += step)
+        {
+            const Cell &texel = column[position >> 16];
+            frame.set(x, y, texel.ch, texel.colorPair);
+        }
+    }
+    if (!lit)
+    {
+        for (; y < screenHeight; ++y)
+            frame.set(x, y, m_tables.floorGlyph(y));
+        return;
+    }
+    // the floor cell each row looks at, for its light
+    for (; y < screenHeight; ++y)
+    {
+        float distance = m_tables.floorDistance(y);
+        int cellX = (int)floor(camera.x + eyeX * distance);
+        int cellY = (int)floor(camera.y + eyeY * distance);
+        frame.set(x, y, m_tables.litFloorGlyph(y, m_lightmap->cellLight(cellX, cellY)));
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include "EntityLayer.h"
+#include "FrameBuffer.h"
+#include "Lightmap.h"
+#include "Raycaster.h"
+#include "RenderTables.h"
+#include "TextureAtlas.h"
+#include "TextureMap.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// Where the view is rendered from
+struct Camera
+{
+    float x = 1.0f;
+    float y = 1.0f;
+    float angle = 0.0f;
+    float fov = 3.14159265f / 3.0f;
+};
+
+// Work done by the last call to Renderer::render
+struct RenderStats
+{
+    long raySteps = 0;      // map lookups made by all rays
+    int maxRaySteps = 0;    // map lookups made by the longest ray
+    int wallHits = 0;       // rays that ended on a wall
+    int columnsTraced = 0;  // columns traced, the others came from the column cache
+    int entitiesConsidered = 0; // entities in the buckets inside the view
+    int entitiesDrawn = 0;      // entities in front of a wall
+    // time spent tracing rays and shading columns, summed over threads,
+    // only measured with timing on
+    double castSeconds = 0;
+    double shadeSeconds = 0;
+};
+
+// Raycasts the world into a FrameBuffer. Knows nothing about the terminal,
+// the frame buffer is the only thing it hands to the output layer.
+class Renderer
+{
+public:
+    void render(const Camera &camera, const WallMap &map, float depth, FrameBuffer &frame);
+
+    // Split the columns across the pool's threads, nullptr renders on the
+    // calling thread only. The pool is not owned by the renderer.
+    void setThreadPool(ThreadPool *pool) { m_threadPool = pool; }
+
+    // Draw these entities over the walls, nullptr for none. Not owned by
+    // the renderer.
+    void setEntities(EntityLayer *entities) { m_entities = entities; }
+
+    // Shade walls and floor with this baked light too, nullptr (or a
+    // lightmap without lights) shades by distance only. Not owned by the
+    // renderer, and the column cache has to be invalidated when it is
+    // baked again.
+    void setLightmap(const Lightmap *lightmap) { m_lightmap = lightmap; }
+
+    // Draw walls with the atlas's textures, picked per cell by textures
+    // (texture 0 everywhere if it is nullptr), or flat with a nullptr
+    // atlas. Neither is owned by the renderer, and the column cache has to
+    // be invalidated when they change.
+    void setTextures(const TextureAtlas *atlas, const TextureMap *textures)
+    {
+        m_atlas = atlas;
+        m_textures = textures;
+    }
+
+    // measure castSeconds and shadeSeconds, costs two clock reads per packet
+    void setTiming(bool timing) { m_timing = timing; }
+
+    // Trace only every step'th column and copy it into the columns up to
+    // the next traced one, to trade resolution for speed. The column cache
+    // is not used while step is over 1.
+    void setColumnStep(int step) { m_columnStep = step < 1 ? 1 : step; }
+    int columnStep() const { return m_columnStep; }
+
+    // Keep each column's hit between frames and reuse it while the camera
+    // stays in the same place. The camera angle is snapped to whole
+    // columns, so turning moves the view by whole columns: the cached hits
+    // and the frame are shifted and only the columns turned into view are
+    // traced. A camera that did not move at all traces nothing. The cache
+    // assumes that render() is given the same map and frame buffer every
+    // time, and must be told about map edits.
+    void setColumnCache(bool enabled);
+    bool columnCache() const { return m_columnCache; }
+    // map cell x, y changed: retrace the columns whose rays cross it
+    void invalidateCell(int x, int y);
+    // retrace everything on the next frame, e.g. for a new map
+    void invalidateColumns() { m_cacheValid = false; }
+
+    const RenderStats &stats() const { return m_stats; }
+    // distance to the wall (or the depth) in each column of the last frame
+    const std::vector<float> &depthBuffer() const { return m_depthBuffer; }
+    Raycaster &raycaster() { return m_raycaster; }
+    const Raycaster &raycaster() const { return m_raycaster; }
+
+private:
+    // columns to trace this frame, and whether the frame can be updated
+    // from the column cache
+    void selectColumns(const Camera &camera, const WallMap &map, float depth, FrameBuffer &frame);
+    void shadeColumn(int x, const RayHit &hit, float eyeX, float eyeY, const Camera &camera,
+                     float depth, FrameBuffer &frame) const;
+    // copy each traced column into the untraced ones after it
+    void fillColumnGaps(FrameBuffer &frame);
+
+private:
+    Raycaster m_raycaster;
+    RenderTables m_tables;
+    ThreadPool *m_threadPool = nullptr;
+    EntityLayer *m_entities = nullptr;
+    const Lightmap *m_lightmap = nullptr;
+    const TextureAtlas *m_atlas = nullptr;
+    const TextureMap *m_textures = nullptr;
+    std::vector<float> m_depthBuffer;
+    RenderStats m_stats;
+    bool m_timing = false;
+    int m_columnStep = 1;
+    std::vector<int> m_columns;             // columns to trace this frame
+
+    // column cache: the hits of the last frame and what they depend on
+    bool m_columnCache = false;
+    bool m_cacheValid = false;
+    std::vector<RayHit> m_hits;
+    std::vector<char> m_stale;              // column has to be traced again
+    Camera m_cachedCamera;
+    long m_cachedAngleIndex = 0;            // camera angle in columns
+    float m_cachedDepth = 0;
+    const WallMap *m_cachedMap = nullptr;
+    const FrameBuffer *m_cachedFrame = nullptr;
+    int m_cachedWidth = 0;
+    int m_cachedHeight = 0;
+    Raycaster::Mode m_cachedMode = Raycaster::Mode::DDA;
+};
@@ -0,0 +1,66 @@
+#include "Swarm.h"
+#include "Random.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void Swarm::spawn(EntityLayer &entities, const WallMap &map, int count, uint64_t seed)
+{
+    Random random(seed);
+    m_first = entities.count();
+    m_speeds.clear();
+    // give up on maps with hardly any floor rather than loop forever
+    long attempts = (long)count * 64;
+    while ((int)m_speeds.size() < count && attempts-- > 0)
+    {
+        int x = random.below(map.width());
+        int y = random.below(map.height());
+        if (map.isWall(x, y))
+            continue;
+        entities.add(x + 0.5f, y + 0.5f, EntityLayer::Npc);
+        // a spread of speeds keeps them from moving in lockstep
+        m_speeds.push_back(1.0f + 1.5f * random.unit());
+    }
+}
+
+void Swarm::update(EntityLayer &entities, const FlowField &field, const WallMap &map, float seconds,
+                   ThreadPool *pool)
+{
+    if (empty() || field.width() != map.width() || field.height() != map.height())
+        return;
+
+    float *xs = entities.xs().data() + m_first;
+    float *ys = entities.ys().data() + m_first;
+    const float *speeds = m_speeds.data();
+    auto moveAgents = [&](int begin, int end)
+    {
+        static const float offsets[5][2] = { { 0, 0 }, { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } };
+        for (int i = begin; i < end; i++)
+        {
+            // head for the centre of the next cell, or of this one at the
+            // target, which keeps agents off the walls on the way
+            int cellX = (int)xs[i], cellY = (int)ys[i];
+            FlowField::Direction direction = field.direction(cellX, cellY);
+            // a field from before a map edit can lead into a new wall
+            if (map.isWall(cellX + (int)offsets[direction][0], cellY + (int)offsets[direction][1]))
+                direction = FlowField::None;
+            float dx = cellX + 0.5f + offsets[direction][0] - xs[i];
+            float dy = cellY + 0.5f + offsets[direction][1] - ys[i];
+            float length = sqrt(dx * dx + dy * dy);
+            if (length < 1e-4f)
+                continue;
+            float step = min(length, speeds[i] * seconds) / length;
+            xs[i] += dx * step;
+            ys[i] += dy * step;
+        }
+    };
+
+    int agents = count();
+    if (pool)
+        pool->parallelFor(0, agents, BatchSize, moveAgents);
+    else
+        moveAgents(0, agents);
+    // relinking touches shared hash chains, so it stays on this thread
+    entities.rebucket(m_first, m_first + agents);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "EntityLayer.h"
+#include "FlowField.h"
+#include "ThreadPool.h"
+#include "WallMap.h"
+
+// Agents that chase the target of a FlowField through the maze. Each agent
+// is an NPC entity of an EntityLayer, so they are drawn like any other
+// entity, and its position lives there; the swarm only adds a speed.
+//
+// A step reads the field once for the agent's cell and moves it towards
+// the centre of the next cell, so a tick costs the same per agent however
+// big the map is. Agents are updated in batches that can be spread over a
+// thread pool, each batch only writing its own agents.
+class Swarm
+{
+public:
+    static const int BatchSize = 4096;
+
+    // Add count agents to entities on random floor cells of map
+    void spawn(EntityLayer &entities, const WallMap &map, int count, uint64_t seed);
+    // forget the agents, for when the entities were cleared
+    void clear() { m_speeds.clear(); }
+
+    int count() const { return (int)m_speeds.size(); }
+    bool empty() const { return m_speeds.empty(); }
+
+    // Move every agent seconds further along the field. The field must
+    // have been searched on map.
+    void update(EntityLayer &entities, const FlowField &field, const WallMap &map, float seconds,
+                ThreadPool *pool);
+
+private:
+    int m_first = 0;                // entity index of the first agent
+    std::vector<float> m_speeds;    // cells per second
+};
@@ -0,0 +1,146 @@
+#include "TextureAtlas.h"
+#include "RenderTables.h"
+#include <algorithm>
+
+using namespace std;
+
+// std::min takes it by reference, so it needs a definition
+const int TextureAtlas::MaxDarken;
+
+// cheap per texel noise, the same on every run
+static uint32_t noise(int texture, int u, int v)
+{
+    uint32_t hash = texture * 0x9e3779b1u ^ u * 0x85ebca6bu ^ v * 0xc2b2ae35u;
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
+    return hash;
+}
+
+void TextureAtlas::colorPair(short pair, short &foreground, short &background)
+{
+    // ncurses colour numbers: 1 red, 2 green, 3 yellow, 6 cyan, 0 black
+    static const short colors[] = { 1, 2, 3, 6 };
+    foreground = pair >= FirstColor && pair < ColorEnd ? colors[pair - FirstColor] : 7;
+    background = 0;
+}
+
+const char *TextureAtlas::textureName(int texture)
+{
+    switch (texture)
+    {
+    case Stone: return "STONE";
+    case Brick: return "BRICK";
+    case Wood:  return "WOOD";
+    case Moss:  return "MOSS";
+    case Metal: return "METAL";
+    }
+    return "?";
+}
+
+TextureAtlas::TextureAtlas()
+{
+    vector<Texel> texels(TextureCount * TexelsPerTexture);
+    for (int level = 0, offset = 0; level < Levels; level++)
+    {
+        m_levelOffset[level] = offset;
+        offset += (Size >> level) * (Size >> level);
+    }
+
+    for (int texture = 0; texture < TextureCount; texture++)
+    {
+        vector<Texel> rows(Size * Size);
+        paint(texture, rows.data());
+        Texel *base = &texels[texture * TexelsPerTexture];
+        for (int v = 0; v < Size; v++)
+            for (int u = 0; u < Size; u++)
+                base[u * Size + v] = rows[v * Size + u];
+
+        // each level averages 2x2 texels of the one above: the rounded
+        // darkening and the colour most of them have
+        for (int level = 1; level < Levels; level++)
+        {
+            int size = Size >> level;
+            const Texel *above = base + m_levelOffset[level - 1];
+            Texel *below = base + m_levelOffset[level];
+            for (int u = 0; u < size; u++)
+                for (int v = 0; v < size; v++)
+                {
+                    const Texel *quad[4] = {
+                        &above[(2 * u) * 2 * size + 2 * v], &above[(2 * u) * 2 * size + 2 * v + 1],
+                        &above[(2 * u + 1) * 2 * size + 2 * v], &above[(2 * u + 1) * 2 * size + 2 * v + 1] };
+                    int darken = 0, best = 0, bestCount = 0;
+                    for (int i = 0; i < 4; i++)
+                    {
+                        darken += quad[i]->darken;
+                        int count = 0;
+                        for (int j = 0; j < 4; j++)
+                            count += quad[j]->colorPair == quad[i]->colorPair;
+                        if (count > bestCount)
+                            best = i, bestCount = count;
+                    }
+                    below[u * size + v] = { quad[best]->colorPair, (uint8_t)((darken + 2) / 4) };
+                }
+        }
+    }
+
+    // the same layout once for every shade
+    m_cells.resize(Shades * texels.size());
+    for (int shade = 0; shade < Shades; shade++)
+        for (size_t i = 0; i < texels.size(); i++)
+        {
+            Cell &cell = m_cells[shade * texels.size() + i];
+            cell.ch = RenderTables::wallShadeGlyph(max(0, shade - texels[i].darken));
+            cell.colorPair = texels[i].colorPair;
+        }
+}
+
+void TextureAtlas::paint(int texture, Texel *texels) const
+{
+    for (int v = 0; v < Size; v++)
+        for (int u = 0; u < Size; u++)
+        {
+            uint32_t random = noise(texture, u, v);
+            short color = 0;
+            int darken = 0;
+            switch (texture)
+            {
+            case Stone:
+            case Moss:
+            {
+                // big blocks, every other row shifted by half a block
+                int shifted = (u + (v / 8 % 2) * 4) % 8;
+                bool mortar = v % 8 == 7 || shifted == 7;
+                darken = mortar ? 2 : random % 5 == 0;
+                if (texture == Moss && !mortar && (noise(texture, u / 3, v / 3) & 3) == 0)
+                    color = Green;
+                break;
+            }
+            case Brick:
+            {
+                int shifted = (u + (v / 4 % 2) * 4) % 8;
+                bool mortar = v % 4 == 3 || shifted == 7;
+                darken = mortar ? 2 : random % 7 == 0;
+                color = mortar ? 0 : Red;
+                break;
+            }
+            case Wood:
+            {
+                // planks with grain running down them
+                bool gap = u % 4 == 3;
+                darken = gap ? 3 : (noise(texture, u, v / 5) & 3) == 0;
+                color = Yellow;
+                break;
+            }
+            case Metal:
+            {
+                bool border = u == 0 || u == Size - 1 || v == 0 || v == Size - 1;
+                bool rivet = (u == 2 || u == Size - 3) && (v == 2 || v == Size - 3);
+                darken = rivet ? 3 : border;
+                color = Cyan;
+                break;
+            }
+            }
+            texels[v * Size + u] = { color, (uint8_t)min(darken, MaxDarken) };
+        }
+}
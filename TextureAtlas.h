@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "FrameBuffer.h"
+
+// The wall textures, all of them in one array.
+//
+// A texel is a colour pair and how many shades darker than the wall's
+// shade (from distance and light) it is drawn, so textures stay visible
+// however far and however lit the wall is. The atlas keeps a copy of
+// every texture for each of the wall shades with the texels turned into
+// frame cells, so drawing a texel is a plain copy.
+//
+// Textures are Size x Size texels with mip levels down to 1x1, each level
+// a box filtered half of the one above. Every level is stored column
+// major: a wall slice is one column of one level, so drawing it walks
+// memory in order. The renderer picks the level whose height is closest
+// to the slice's height on screen without going over, so far walls read
+// a handful of texels and the 1x1 level is as cheap as a flat wall.
+class TextureAtlas
+{
+public:
+    enum Texture { Stone, Brick, Wood, Moss, Metal, TextureCount };
+
+    static const int SizeShift = 4;             // 16x16 texels at level 0
+    static const int Size = 1 << SizeShift;
+    static const int Levels = SizeShift + 1;
+    static const int MaxDarken = 3;
+    static const int Shades = 5;                // wall shades, as in RenderTables
+
+    // colour pairs the textures are drawn with, to be defined by the output
+    static const short FirstColor = 6;
+    enum Color { Red = FirstColor, Green, Yellow, Cyan, ColorEnd };
+    // foreground and background of pair FirstColor + i, ncurses colour numbers
+    static void colorPair(short pair, short &foreground, short &background);
+
+    struct Texel
+    {
+        short colorPair;
+        uint8_t darken;         // shades darker than the wall, 0 to MaxDarken
+    };
+
+    TextureAtlas();
+
+    static const char *textureName(int texture);
+
+    // column u of texture at mip level drawn on a wall of shade (0 to
+    // Shades - 1), Size >> level cells from top to bottom
+    const Cell *column(int texture, int shade, int level, int u) const
+    {
+        return &m_cells[(shade * TextureCount + texture) * TexelsPerTexture + m_levelOffset[level]
+                        + (u << (SizeShift - level))];
+    }
+    // mip level for a slice height rows high on screen
+    static int levelFor(int height)
+    {
+        int level = 0;
+        while (level < Levels - 1 && (Size >> level) > height)
+            level++;
+        return level;
+    }
+
+private:
+    static const int TexelsPerTexture = Size * Size * 4 / 3;       // all levels, 16x16 down to 1x1
+
+    // level 0 of texture, row major, filled in procedurally
+    void paint(int texture, Texel *texels) const;
+
+private:
+    std::vector<Cell> m_cells;      // shade, texture, level, column, row
+    int m_levelOffset[Levels];
+};
@@ -0,0 +1,113 @@
+#include "TextureMap.h"
+#include "TextureAtlas.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// File layout: TextureFileHeader, then blockCount times a uint32_t block
+// index followed by the block's cells
+static const char TextureMagic[8] = { 'F', 'P', 'S', 'T', 'E', 'X', '1', 0 };
+
+struct TextureFileHeader
+{
+    char magic[8];
+    int32_t width;
+    int32_t height;
+    uint32_t blockCount;
+    uint32_t reserved;
+};
+
+void TextureMap::resize(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+    m_blocksPerRow = (width + BlockSize - 1) >> BlockShift;
+    m_blocks.clear();
+    m_blocks.resize((size_t)m_blocksPerRow * ((height + BlockSize - 1) >> BlockShift));
+}
+
+long TextureMap::fill(int left, int top, int right, int bottom, uint8_t texture)
+{
+    left = max(left, 0);
+    top = max(top, 0);
+    right = min(right, m_width);
+    bottom = min(bottom, m_height);
+    long changed = 0;
+    for (int y = top; y < bottom; y++)
+        for (int x = left; x < right; x++)
+        {
+            unique_ptr<Block> &block = m_blocks[(y >> BlockShift) * m_blocksPerRow + (x >> BlockShift)];
+            if (!block)
+            {
+                if (texture == 0)
+                    continue;
+                block.reset(new Block);
+                memset(block->cells, 0, sizeof(block->cells));
+            }
+            uint8_t &cell = block->cells[cellIndex(x, y)];
+            changed += cell != texture;
+            cell = texture;
+        }
+    return changed;
+}
+
+bool TextureMap::save(const string &fileName) const
+{
+    TextureFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TextureMagic, sizeof(TextureMagic));
+    header.width = m_width;
+    header.height = m_height;
+    for (const auto &block : m_blocks)
+        header.blockCount += block != nullptr;
+
+    string tempName = fileName + ".tmp";
+    FILE *file = fopen(tempName.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; ok && i < m_blocks.size(); i++)
+    {
+        if (!m_blocks[i])
+            continue;
+        uint32_t index = i;
+        ok = fwrite(&index, sizeof(index), 1, file) == 1 && fwrite(m_blocks[i].get(), sizeof(Block), 1, file) == 1;
+    }
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tempName.c_str(), fileName.c_str()) != 0)
+    {
+        remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool TextureMap::load(const string &fileName, int width, int height)
+{
+    resize(width, height);
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (!file)
+        return false;
+    TextureFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, TextureMagic, sizeof(TextureMagic)) == 0
+        && header.width == width && header.height == height;
+    for (uint32_t i = 0; ok && i < header.blockCount; i++)
+    {
+        uint32_t index;
+        unique_ptr<Block> block(new Block);
+        ok = fread(&index, sizeof(index), 1, file) == 1 && index < m_blocks.size()
+            && fread(block.get(), sizeof(Block), 1, file) == 1
+            // ids index the atlas, a corrupt block must not point past it
+            && all_of(begin(block->cells), end(block->cells),
+                      [](uint8_t texture) { return texture < TextureAtlas::TextureCount; });
+        if (ok)
+            m_blocks[index] = move(block);
+    }
+    fclose(file);
+    if (!ok)
+        resize(width, height);
+    return ok;
+}
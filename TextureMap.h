@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The texture of each map cell, for the walls. Cells nobody painted have
+// texture 0.
+//
+// Like the lightmap the ids are kept in blocks of 16x16 cells that only
+// exist where something was painted, so an unpainted map of any size costs
+// a table of null pointers. Saved next to the map file.
+class TextureMap
+{
+public:
+    static const int BlockShift = 4;
+    static const int BlockSize = 1 << BlockShift;
+
+    // size the map, every cell back to texture 0
+    void resize(int width, int height);
+    void clear() { resize(m_width, m_height); }
+
+    uint8_t at(int x, int y) const
+    {
+        if ((unsigned)x >= (unsigned)m_width || (unsigned)y >= (unsigned)m_height)
+            return 0;
+        const Block *block = m_blocks[(y >> BlockShift) * m_blocksPerRow + (x >> BlockShift)].get();
+        return block ? block->cells[cellIndex(x, y)] : 0;
+    }
+    // give cells [left, right) x [top, bottom) texture, returns the cells changed
+    long fill(int left, int top, int right, int bottom, uint8_t texture);
+
+    // Write the painted blocks to fileName, replacing it atomically.
+    // Returns false and leaves the file alone on failure.
+    bool save(const std::string &fileName) const;
+    // Read the textures saved for a width x height map. Returns false, and
+    // leaves every cell at texture 0, if the file is missing, is for a
+    // map of another size or has a texture id the atlas does not have.
+    bool load(const std::string &fileName, int width, int height);
+
+private:
+    struct Block
+    {
+        uint8_t cells[BlockSize * BlockSize];
+    };
+
+    static int cellIndex(int x, int y) { return ((y & (BlockSize - 1)) << BlockShift) | (x & (BlockSize - 1)); }
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_blocksPerRow = 0;
+    std::vector<std::unique_ptr<Block>> m_blocks;   // null for blocks all texture 0
+};
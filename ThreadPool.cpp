@@ -0,0 +1,91 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+using namespace std;
+
+// set on pool workers, and on the caller while it helps with a loop
+static thread_local bool t_insidePool = false;
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = max(1u, thread::hardware_concurrency());
+    for (int i = 1; i < threadCount; i++)
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto &worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::parallelFor(int begin, int end, int grain, const function<void(int, int)> &body)
+{
+    if (end <= begin)
+        return;
+    grain = max(1, grain);
+    if (m_workers.empty() || t_insidePool || end - begin <= grain)
+    {
+        body(begin, end);
+        return;
+    }
+
+    lock_guard<mutex> call(m_callMutex);
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_body = &body;
+        m_next = begin;
+        m_end = end;
+        m_grain = grain;
+        m_busyWorkers = m_workers.size();
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    t_insidePool = true;
+    runChunks();
+    t_insidePool = false;
+
+    unique_lock<mutex> lock(m_mutex);
+    m_done.wait(lock, [&] { return m_busyWorkers == 0; });
+    m_body = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+    t_insidePool = true;
+    unsigned seenGeneration = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seenGeneration; });
+            if (m_stop)
+                return;
+            seenGeneration = m_generation;
+        }
+
+        runChunks();
+
+        lock_guard<mutex> lock(m_mutex);
+        if (--m_busyWorkers == 0)
+            m_done.notify_one();
+    }
+}
+
+void ThreadPool::runChunks()
+{
+    while (true)
+    {
+        int chunkBegin = m_next.fetch_add(m_grain);
+        if (chunkBegin >= m_end)
+            return;
+        (*m_body)(chunkBegin, min(chunkBegin + m_grain, m_end));
+    }
+}
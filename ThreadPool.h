@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads for data parallel loops. The calling
+// thread joins in, so a pool of N threads starts N - 1 workers.
+class ThreadPool
+{
+public:
+    // threadCount 0 uses one thread per hardware core
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int threadCount() const { return m_workers.size() + 1; }
+
+    // Call body(chunkBegin, chunkEnd) over [begin, end) in chunks of grain
+    // items. Threads take the next chunk from a shared counter as they
+    // finish, so slow chunks do not hold up the others. Returns when every
+    // chunk is done. Calls made from inside a body run inline.
+    void parallelFor(int begin, int end, int grain, const std::function<void(int, int)> &body);
+
+private:
+    void workerLoop();
+    void runChunks();
+
+private:
+    std::vector<std::thread> m_workers;
+    std::mutex m_callMutex;     // one parallelFor at a time from outside the pool
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    unsigned m_generation = 0;
+    int m_busyWorkers = 0;
+    bool m_stop = false;
+
+    const std::function<void(int, int)> *m_body = nullptr;
+    std::atomic<int> m_next{0};
+    int m_end = 0;
+    int m_grain = 1;
+};
@@ -0,0 +1,337 @@
+#include "WallMap.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// File layout: MapFileHeader, then one uint64_t file offset per chunk in
+// row major chunk order, then the chunks (ChunkWords words each) starting
+// on a page boundary.
+static const char MapMagic[8] = { 'F', 'P', 'S', 'M', 'A', 'P', '1', 0 };
+static const uint32_t MapVersion = 1;
+static const uint64_t MapPageSize = 4096;
+
+struct MapFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t tileShift;
+    uint32_t chunkShift;
+    int32_t width;
+    int32_t height;
+    uint32_t chunksPerRow;
+    uint32_t chunksPerColumn;
+    float startX;
+    float startY;
+    float startAngle;
+    uint64_t indexOffset;
+    uint64_t dataOffset;
+};
+
+WallMap &WallMap::operator=(const WallMap &other)
+{
+    if (this == &other)
+        return *this;
+
+    // always copy into memory, even if other is mapped from a file
+    vector<uint64_t> storage(other.m_chunks.size() * ChunkWords);
+    for (size_t i = 0; i < other.m_chunks.size(); i++)
+        copy(other.m_chunks[i], other.m_chunks[i] + ChunkWords, &storage[i * ChunkWords]);
+
+    unmap();
+    m_width = other.m_width;
+    m_height = other.m_height;
+    m_chunksPerRow = other.m_chunksPerRow;
+    m_chunksPerColumn = other.m_chunksPerColumn;
+    m_storage.swap(storage);
+    linkChunks();
+    return *this;
+}
+
+WallMap &WallMap::operator=(WallMap &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    unmap();
+    m_width = other.m_width;
+    m_height = other.m_height;
+    m_chunksPerRow = other.m_chunksPerRow;
+    m_chunksPerColumn = other.m_chunksPerColumn;
+    // the chunk pointers stay valid, moving a vector keeps its buffer
+    m_chunks = move(other.m_chunks);
+    m_storage = move(other.m_storage);
+    m_mapping = other.m_mapping;
+    m_mappingSize = other.m_mappingSize;
+
+    // other is left an empty map
+    other.m_width = other.m_height = 0;
+    other.m_chunksPerRow = other.m_chunksPerColumn = 0;
+    other.m_chunks.clear();
+    other.m_storage.clear();
+    other.m_mapping = nullptr;
+    other.m_mappingSize = 0;
+    return *this;
+}
+
+WallMap::~WallMap()
+{
+    unmap();
+}
+
+void WallMap::unmap()
+{
+    if (m_mapping)
+        munmap(m_mapping, m_mappingSize);
+    m_mapping = nullptr;
+    m_mappingSize = 0;
+}
+
+void WallMap::resize(int width, int height, bool wall)
+{
+    unmap();
+    m_width = width;
+    m_height = height;
+    m_chunksPerRow = (width + ChunkSize - 1) >> ChunkShift;
+    m_chunksPerColumn = (height + ChunkSize - 1) >> ChunkShift;
+    m_storage.assign((size_t)m_chunksPerRow * m_chunksPerColumn * ChunkWords, wall ? ~0ULL : 0);
+    linkChunks();
+}
+
+void WallMap::linkChunks()
+{
+    m_chunks.resize((size_t)m_chunksPerRow * m_chunksPerColumn);
+    for (size_t i = 0; i < m_chunks.size(); i++)
+        m_chunks[i] = &m_storage[i * ChunkWords];
+}
+
+void WallMap::fill(bool wall)
+{
+    for (auto chunk : m_chunks)
+        std::fill(chunk, chunk + ChunkWords, wall ? ~0ULL : 0);
+}
+
+void WallMap::fillRow(int y, int x, int end, bool wall)
+{
+    int shift = (y & 7) << 3;
+    while (x < end)
+    {
+        // the cells of this row in the current tile from x up to end
+        int tileEnd = min(end, (x & ~7) + 8);
+        uint64_t bits = rowBits(x, tileEnd) << shift;
+        uint64_t &word = tileWord(x, y);
+        word = wall ? word | bits : word & ~bits;
+        x = tileEnd;
+    }
+}
+
+void WallMap::flipRow(int y, int x, int end)
+{
+    int shift = (y & 7) << 3;
+    while (x < end)
+    {
+        int tileEnd = min(end, (x & ~7) + 8);
+        tileWord(x, y) ^= rowBits(x, tileEnd) << shift;
+        x = tileEnd;
+    }
+}
+
+void WallMap::copyRect(const WallMap &source, int sourceLeft, int sourceTop, int left, int top, int width, int height)
+{
+    for (int i = 0; i < height; i++)
+    {
+        // a tile row of 8 cells at a time
+        int sourceShift = ((sourceTop + i) & 7) << 3;
+        int shift = ((top + i) & 7) << 3;
+        for (int x = 0; x < width; x += 8)
+        {
+            uint64_t bits = (source.tileWord(sourceLeft + x, sourceTop + i) >> sourceShift) & 0xff;
+            uint64_t &word = tileWord(left + x, top + i);
+            word = (word & ~(0xffULL << shift)) | (bits << shift);
+        }
+    }
+}
+
+uint64_t WallMap::hash() const
+{
+    uint64_t hash = ((uint64_t)m_width << 32) ^ (uint64_t)m_height;
+    for (int y = 0; y < m_height; y += 8)
+    {
+        // leave out the bits of a partial tile that lie past the map's edge
+        int rows = min(8, m_height - y);
+        uint64_t rowMask = rows == 8 ? ~0ULL : (1ULL << (rows << 3)) - 1;
+        for (int x = 0; x < m_width; x += 8)
+        {
+            uint64_t columns = min(8, m_width - x);
+            uint64_t mask = rowMask & (0x0101010101010101ULL * ((1ULL << columns) - 1));
+            hash ^= tileWord(x, y) & mask;
+            hash *= 0x9e3779b97f4a7c15ULL;
+            hash ^= hash >> 29;
+        }
+    }
+    return hash;
+}
+
+int WallMap::countWallsInRow(int y, int x, int end) const
+{
+    int shift = (y & 7) << 3;
+    int count = 0;
+    while (x < end)
+    {
+        int tileEnd = min(end, (x & ~7) + 8);
+        count += __builtin_popcountll((tileWord(x, y) >> shift) & rowBits(x, tileEnd));
+        x = tileEnd;
+    }
+    return count;
+}
+
+int WallMap::scanRow(int y, int x, int end, uint64_t invert) const
+{
+    int shift = (y & 7) << 3;
+    while (x < end)
+    {
+        // the 8 cells of this row in the current tile, starting at x
+        unsigned bits = ((tileWord(x, y) ^ invert) >> shift) & 0xff;
+        bits &= 0xff << (x & 7);
+        if (bits)
+            return min(end, (x & ~7) + __builtin_ctz(bits));
+        x = (x & ~7) + 8;
+    }
+    return end;
+}
+
+int WallMap::nextWallInColumn(int x, int y, int end) const
+{
+    const uint64_t column = 0x0101010101010101ULL << (x & 7);
+    while (y < end)
+    {
+        // the 8 cells of this column in the current tile, starting at y
+        uint64_t bits = tileWord(x, y) & column;
+        bits &= ~0ULL << ((y & 7) << 3);
+        if (bits)
+            return min(end, (y & ~7) + (__builtin_ctzll(bits) >> 3));
+        y = (y & ~7) + 8;
+    }
+    return end;
+}
+
+bool WallMap::save(const string &fileName, const PlayerStart &start) const
+{
+    MapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MapMagic, sizeof(MapMagic));
+    header.version = MapVersion;
+    header.tileShift = TileShift;
+    header.chunkShift = ChunkShift;
+    header.width = m_width;
+    header.height = m_height;
+    header.chunksPerRow = m_chunksPerRow;
+    header.chunksPerColumn = m_chunksPerColumn;
+    header.startX = start.x;
+    header.startY = start.y;
+    header.startAngle = start.angle;
+    header.indexOffset = sizeof(header);
+    uint64_t indexEnd = header.indexOffset + m_chunks.size() * sizeof(uint64_t);
+    header.dataOffset = (indexEnd + MapPageSize - 1) / MapPageSize * MapPageSize;
+
+    vector<uint64_t> index(m_chunks.size());
+    for (size_t i = 0; i < index.size(); i++)
+        index[i] = header.dataOffset + i * ChunkWords * sizeof(uint64_t);
+
+    // write next to the target and rename over it, so a map that is
+    // currently mapped from fileName keeps reading the old file
+    string tempName = fileName + ".tmp";
+    FILE *file = fopen(tempName.c_str(), "wb");
+    if (!file)
+        return false;
+    vector<char> padding(header.dataOffset - indexEnd, 0);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(index.data(), sizeof(uint64_t), index.size(), file) == index.size()
+        && fwrite(padding.data(), 1, padding.size(), file) == padding.size();
+    for (size_t i = 0; ok && i < m_chunks.size(); i++)
+        ok = fwrite(m_chunks[i], sizeof(uint64_t), ChunkWords, file) == (size_t)ChunkWords;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tempName.c_str(), fileName.c_str()) != 0)
+    {
+        remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool WallMap::load(const string &fileName, PlayerStart &start)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(MapFileHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    // private mapping: pages are read on demand and edits are copy on write
+    size_t size = info.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    const char *base = (const char *)mapping;
+    const MapFileHeader &header = *(const MapFileHeader *)base;
+    uint64_t chunkBytes = ChunkWords * sizeof(uint64_t);
+    uint64_t chunkCount = (uint64_t)header.chunksPerRow * header.chunksPerColumn;
+    // every offset is checked as room left in the file, a corrupt header
+    // must not be able to wrap a sum around past the end of the mapping
+    bool valid = memcmp(header.magic, MapMagic, sizeof(MapMagic)) == 0
+        && header.version == MapVersion
+        && header.tileShift == TileShift && header.chunkShift == ChunkShift
+        && header.width > 0 && header.height > 0
+        && header.width <= MaxSide && header.height <= MaxSide
+        && header.chunksPerRow == (uint32_t)((header.width + ChunkSize - 1) >> ChunkShift)
+        && header.chunksPerColumn == (uint32_t)((header.height + ChunkSize - 1) >> ChunkShift)
+        && header.indexOffset % sizeof(uint64_t) == 0
+        && header.indexOffset <= size
+        && chunkCount <= (size - header.indexOffset) / sizeof(uint64_t)
+        && chunkBytes <= size
+        // the player is put at the start as is, it has to be in the map
+        && isfinite(header.startAngle)
+        && header.startX >= 0 && header.startX < header.width
+        && header.startY >= 0 && header.startY < header.height;
+    const uint64_t *index = valid ? (const uint64_t *)(base + header.indexOffset) : nullptr;
+    for (uint64_t i = 0; valid && i < chunkCount; i++)
+        valid = index[i] % sizeof(uint64_t) == 0 && index[i] <= size - chunkBytes;
+    if (!valid)
+    {
+        munmap(mapping, size);
+        return false;
+    }
+
+    // the chunks are never read ahead, rays jump around the map
+    madvise(mapping, size, MADV_RANDOM);
+
+    unmap();
+    m_storage.clear();
+    m_storage.shrink_to_fit();
+    m_width = header.width;
+    m_height = header.height;
+    m_chunksPerRow = header.chunksPerRow;
+    m_chunksPerColumn = header.chunksPerColumn;
+    m_chunks.resize(chunkCount);
+    for (uint64_t i = 0; i < chunkCount; i++)
+        m_chunks[i] = (uint64_t *)(base + index[i]);
+    m_mapping = mapping;
+    m_mappingSize = size;
+
+    start.x = header.startX;
+    start.y = header.startY;
+    start.angle = header.startAngle;
+    return true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Where the player starts on a map loaded from disk
+struct PlayerStart
+{
+    float x = 1.0f;
+    float y = 1.0f;
+    float angle = 0.0f;
+};
+
+// Wall occupancy of the world, one bit per cell.
+//
+// Cells are packed into 8x8 tiles, one 64-bit word per tile, so a ray
+// crossing a small area stays in a few cache lines whatever its direction.
+// Tiles are grouped into 128x128 cell chunks of 2 KB that are found through
+// a chunk table. Cells outside the map are neither walls nor floor, check
+// inBounds() first.
+//
+// On disk a map is a header, a chunk index and the chunks themselves in
+// exactly their in-memory layout. load() maps the file into memory instead
+// of reading it, so opening is instant whatever the size and the kernel
+// only pages in the chunks that are actually looked at. Edits to a loaded
+// map stay private to the process until it is saved.
+class WallMap
+{
+public:
+    static const int TileShift = 3;                             // 8x8 cells per tile
+    static const int ChunkShift = 7;                            // 128x128 cells per chunk
+    static const int ChunkSize = 1 << ChunkShift;
+    static const int TilesPerChunkRow = 1 << (ChunkShift - TileShift);
+    static const int ChunkWords = TilesPerChunkRow * TilesPerChunkRow;
+    static const int MaxSide = 1 << 20;                         // largest width or height a map file may have
+
+    WallMap() = default;
+    WallMap(int width, int height, bool wall = false) { resize(width, height, wall); }
+    WallMap(const WallMap &other) { *this = other; }
+    WallMap &operator=(const WallMap &other);
+    // moves hand over the chunks, in memory or mapped, without copying them
+    WallMap(WallMap &&other) noexcept { *this = std::move(other); }
+    WallMap &operator=(WallMap &&other) noexcept;
+    ~WallMap();
+
+    // Resize to width x height cells, every cell set to wall or floor
+    void resize(int width, int height, bool wall = false);
+    void fill(bool wall);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    bool inBounds(int x, int y) const { return x >= 0 && x < m_width && y >= 0 && y < m_height; }
+
+    bool isWall(int x, int y) const
+    {
+        return (tileWord(x, y) >> bitIndex(x, y)) & 1;
+    }
+    void setWall(int x, int y, bool wall)
+    {
+        uint64_t &word = tileWord(x, y);
+        uint64_t bit = 1ULL << bitIndex(x, y);
+        word = wall ? word | bit : word & ~bit;
+    }
+
+    // Set cells [x, end) of row y to wall or floor, 8 cells at a time
+    void fillRow(int y, int x, int end, bool wall);
+    // Turn walls into floor and floor into walls in cells [x, end) of row y
+    void flipRow(int y, int x, int end);
+    // Copy the width x height cells of source at sourceLeft, sourceTop to
+    // left, top. Both lefts must be multiples of 8: whole tile rows are
+    // copied, so a width that is not one also copies the cells up to the
+    // next multiple of 8.
+    void copyRect(const WallMap &source, int sourceLeft, int sourceTop, int left, int top, int width, int height);
+    // number of walls in cells [x, end) of row y
+    int countWallsInRow(int y, int x, int end) const;
+
+    // First x in [x, end) of row y that is a wall (or floor), end if none.
+    // Whole tile rows of 8 cells are skipped at a time.
+    int nextWallInRow(int y, int x, int end) const { return scanRow(y, x, end, 0); }
+    int nextFloorInRow(int y, int x, int end) const { return scanRow(y, x, end, ~0ULL); }
+    // First y in [y, end) of column x that is a wall, end if none
+    int nextWallInColumn(int x, int y, int end) const;
+
+    // Hash of the size and the cells, the same for equal maps however
+    // they were made. For keying data derived from the map, such as caches.
+    uint64_t hash() const;
+
+    // bytes used for the cell storage (mapped or in memory)
+    size_t memoryBytes() const { return m_chunks.size() * ChunkWords * sizeof(uint64_t); }
+    bool isMapped() const { return m_mapping != nullptr; }
+
+    // Write the map to fileName, replacing it atomically. Returns false and
+    // leaves the file alone on failure.
+    bool save(const std::string &fileName, const PlayerStart &start) const;
+    // Map fileName into memory. Returns false, and leaves this map as it
+    // was, if the file is missing or is not a map file.
+    bool load(const std::string &fileName, PlayerStart &start);
+
+private:
+    const uint64_t &tileWord(int x, int y) const
+    {
+        const uint64_t *chunk = m_chunks[(y >> ChunkShift) * m_chunksPerRow + (x >> ChunkShift)];
+        int tileX = (x >> TileShift) & (TilesPerChunkRow - 1);
+        int tileY = (y >> TileShift) & (TilesPerChunkRow - 1);
+        return chunk[tileY * TilesPerChunkRow + tileX];
+    }
+    uint64_t &tileWord(int x, int y)
+    {
+        return const_cast<uint64_t &>(static_cast<const WallMap *>(this)->tileWord(x, y));
+    }
+    static int bitIndex(int x, int y) { return ((y & 7) << 3) | (x & 7); }
+    // bits of cells [x, end) of a tile row, end no further than the tile's end
+    static uint64_t rowBits(int x, int end) { return (0xffULL << (x & 7)) & (0xffULL >> ((x | 7) + 1 - end)); }
+
+    // scan with the tile bits xor'ed with invert, so 0 looks for walls
+    // and ~0 looks for floor
+    int scanRow(int y, int x, int end, uint64_t invert) const;
+    void linkChunks();
+    void unmap();
+
+private:
+    int m_width = 0;
+    int m_height = 0;
+    int m_chunksPerRow = 0;
+    int m_chunksPerColumn = 0;
+    std::vector<uint64_t *> m_chunks;
+    std::vector<uint64_t> m_storage;
+    void *m_mapping = nullptr;
+    size_t m_mappingSize = 0;
+};
@@ -0,0 +1,417 @@
+// Microbenchmarks of the hot kernels, each on its own, so that a slower
+// frame can be traced back to the kernel that got slower. Results are
+// written as JSON and compared with a baseline written by an earlier run.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+
+#include "AnsiOutput.h"
+#include "DistanceField.h"
+#include "FrameBuffer.h"
+#include "MazeGenerator.h"
+#include "MiniMap.h"
+#include "Random.h"
+#include "Raycaster.h"
+
+using namespace std;
+
+struct Options
+{
+    string outputFile = "bench_results.json";
+    string baselineFile;
+    string filter;              // only run benchmarks whose name contains this
+    double minTime = 0.3;       // seconds to spend on each benchmark
+    double threshold = 10;      // slowdown in percent that counts as a regression
+    bool strict = false;        // exit with 1 on a regression
+};
+
+// Time per operation of one benchmark, over several samples
+struct Result
+{
+    string name;
+    int samples = 0;
+    double median = 0;      // nanoseconds per operation
+    double mean = 0;
+    double stddev = 0;
+    double min = 0;
+};
+
+static void usage()
+{
+    printf("usage: fps_bench [options]\n"
+           "  --output FILE      write the results to FILE (default bench_results.json)\n"
+           "  --baseline FILE    compare with the results in FILE\n"
+           "  --filter TEXT      only run the benchmarks whose name contains TEXT\n"
+           "  --min-time S       seconds to spend on each benchmark (default 0.3)\n"
+           "  --threshold PCT    slowdown that counts as a regression (default 10)\n"
+           "  --strict           exit with 1 if anything regressed\n");
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--output" && hasValue)              options.outputFile = argv[++i];
+        else if (arg == "--baseline" && hasValue)       options.baselineFile = argv[++i];
+        else if (arg == "--filter" && hasValue)         options.filter = argv[++i];
+        else if (arg == "--min-time" && hasValue)       options.minTime = atof(argv[++i]);
+        else if (arg == "--threshold" && hasValue)      options.threshold = atof(argv[++i]);
+        else if (arg == "--strict")                     options.strict = true;
+        else
+        {
+            usage();
+            return false;
+        }
+    }
+    return true;
+}
+
+// keeps the compiler from dropping work whose result is otherwise unused
+static volatile long sink;
+
+class Bench
+{
+public:
+    explicit Bench(const Options &options) : m_options(options) {}
+
+    // Time op, which does opsPerCall operations per call. Calls are
+    // batched into samples of at least a few milliseconds, and samples
+    // are taken until minTime has passed.
+    void run(const string &name, int opsPerCall, const function<void()> &op)
+    {
+        if (!m_options.filter.empty() && name.find(m_options.filter) == string::npos)
+            return;
+        using Clock = chrono::steady_clock;
+
+        // warm up and find how many calls make a sample
+        auto start = Clock::now();
+        op();
+        double callSeconds = chrono::duration<double>(Clock::now() - start).count();
+        long callsPerSample = max(1L, (long)(0.005 / max(callSeconds, 1e-9)));
+
+        vector<double> samples;
+        double total = 0;
+        // slow kernels get fewer samples rather than minutes of running
+        size_t minSamples = callSeconds > 0.2 ? 3 : 5;
+        while ((total < m_options.minTime || samples.size() < minSamples) && samples.size() < 200)
+        {
+            start = Clock::now();
+            for (long i = 0; i < callsPerSample; i++)
+                op();
+            double seconds = chrono::duration<double>(Clock::now() - start).count();
+            total += seconds;
+            samples.push_back(seconds * 1e9 / (callsPerSample * opsPerCall));
+        }
+
+        Result result;
+        result.name = name;
+        result.samples = samples.size();
+        sort(samples.begin(), samples.end());
+        result.median = samples[samples.size() / 2];
+        result.min = samples.front();
+        for (double sample : samples)
+            result.mean += sample;
+        result.mean /= samples.size();
+        for (double sample : samples)
+            result.stddev += (sample - result.mean) * (sample - result.mean);
+        result.stddev = samples.size() > 1 ? sqrt(result.stddev / (samples.size() - 1)) : 0;
+        m_results.push_back(result);
+        printf("%-32s %14.1f ns  (+-%.1f, %d samples)\n", name.c_str(), result.median, result.stddev,
+               result.samples);
+        fflush(stdout);
+    }
+
+    const vector<Result> &results() const { return m_results; }
+
+private:
+    const Options &m_options;
+    vector<Result> m_results;
+};
+
+// an empty room with walls only around it
+static void openRoom(WallMap &map, int width, int height)
+{
+    map.resize(width, height);
+    map.fillRow(0, 0, width, true);
+    map.fillRow(height - 1, 0, width, true);
+    for (int y = 0; y < height; y++)
+    {
+        map.setWall(0, y, true);
+        map.setWall(width - 1, y, true);
+    }
+}
+
+static void rayBenchmarks(Bench &bench)
+{
+    // one ray across an open room to the far wall, the distance is about the room's width
+    for (int distance : { 4, 16, 64, 256 })
+    {
+        WallMap map;
+        openRoom(map, distance + 2, distance + 2);
+        DistanceField field;
+        field.build(map);
+        float originY = map.height() / 2 + 0.5f;
+        for (Raycaster::Mode mode : { Raycaster::Mode::DDA, Raycaster::Mode::Field })
+        {
+            Raycaster raycaster;
+            raycaster.setMode(mode);
+            raycaster.setDistanceField(&field);
+            string name = string("raycast/") + (mode == Raycaster::Mode::DDA ? "dda" : "field") + "/d" + to_string(distance);
+            bench.run(name, 1, [&]
+            {
+                sink += raycaster.cast(map, 1.5f, originY, 0.9998f, 0.02f, 1000.0f).steps;
+            });
+        }
+    }
+
+    // the corner test on hits from random spots in a maze
+    WallMap map;
+    MazeGenerator generator;
+    generator.generate(map, 30, 30, 2, 1);
+    Raycaster raycaster;
+    Random random(1);
+    struct Ray { float x, y, eyeX, eyeY; RayHit hit; };
+    vector<Ray> rays;
+    while (rays.size() < 256)
+    {
+        Ray ray;
+        ray.x = random.unit() * map.width();
+        ray.y = random.unit() * map.height();
+        if (map.isWall((int)ray.x, (int)ray.y))
+            continue;
+        float angle = random.unit() * 6.2831853f;
+        ray.eyeX = sin(angle);
+        ray.eyeY = cos(angle);
+        ray.hit = raycaster.cast(map, ray.x, ray.y, ray.eyeX, ray.eyeY, 1000.0f);
+        rays.push_back(ray);
+    }
+    bench.run("tile_edge", rays.size(), [&]
+    {
+        long edges = 0;
+        for (const Ray &ray : rays)
+            edges += raycaster.isTileEdge(ray.hit, ray.x, ray.y, ray.eyeX, ray.eyeY);
+        sink += edges;
+    });
+}
+
+static void mazeBenchmarks(Bench &bench)
+{
+    MazeGenerator generator;
+    WallMap map;
+    unsigned seed = 1;
+    for (int size : { 10, 64, 256, 1024, 4096 })
+        for (MazeGenerator::Algorithm algorithm : { MazeGenerator::Backtracker, MazeGenerator::Eller })
+        {
+            string name = string("maze/") + (algorithm == MazeGenerator::Backtracker ? "backtracker" : "eller") + "/" + to_string(size);
+            bench.run(name, 1, [&] { generator.generate(map, size, size, 2, seed++, algorithm); });
+        }
+}
+
+static void miniMapBenchmarks(Bench &bench)
+{
+    // drawing the whole view, on maps from smaller than it to far bigger
+    for (int cells : { 16, 128, 1024 })
+    {
+        WallMap map;
+        MazeGenerator generator;
+        generator.generate(map, cells, cells, 2, 1);
+        for (bool overview : { false, true })
+        {
+            MiniMap miniMap;
+            miniMap.resize(80, 40);
+            miniMap.setOverview(overview);
+            int focus = map.width() / 2;
+            bench.run(string("minimap/") + (overview ? "overview" : "full") + "/" + to_string(map.width()), 1, [&]
+            {
+                miniMap.invalidate();
+                miniMap.update(map, focus, focus, focus, focus);
+                sink += miniMap.changedCells().size();
+            });
+        }
+    }
+
+    // the marker moving one cell at a time, with the occasional scroll
+    WallMap map;
+    MazeGenerator generator;
+    generator.generate(map, 128, 128, 2, 1);
+    MiniMap miniMap;
+    miniMap.resize(80, 40);
+    int step = 0;
+    bench.run("minimap/step", 1, [&]
+    {
+        int x = 1 + step++ % (map.width() - 2);
+        miniMap.update(map, x, map.height() / 2, x, map.height() / 2);
+        sink += miniMap.changedCells().size();
+    });
+}
+
+static void flushBenchmarks(Bench &bench)
+{
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0)
+        return;
+    AnsiOutput output;
+    output.setFd(fd);
+    output.resize(210, 70);
+    for (short pair = 1; pair <= 4; pair++)
+        output.definePair(pair, 0, pair);
+
+    FrameBuffer frame;
+    frame.resize(200, 60);
+    static const wchar_t glyphs[] = { L' ', L'█', L'▓', L'▒', L'░', L'#', L'x', L'.', L'-' };
+    Random random(1);
+    auto scribble = [&](int cells)
+    {
+        for (int i = 0; i < cells; i++)
+            frame.set(random.below(frame.width()), random.below(frame.height()),
+                      glyphs[random.below(sizeof(glyphs) / sizeof(glyphs[0]))], random.below(5));
+    };
+    scribble(frame.width() * frame.height());
+
+    // the whole frame every time, and only a few changed cells
+    bench.run("flush/full/200x60", 1, [&]
+    {
+        output.beginFrame();
+        output.presentFrame(frame, 0, 0, false);
+        output.endFrame();
+        sink += output.stats().bytes;
+    });
+    bench.run("flush/diff/200x60", 1, [&]
+    {
+        scribble(20);
+        output.beginFrame();
+        output.presentFrame(frame, 0, 0, true);
+        output.endFrame();
+        sink += output.stats().bytes;
+    });
+    close(fd);
+}
+
+static bool writeResults(const string &fileName, const vector<Result> &results)
+{
+    FILE *file = fopen(fileName.c_str(), "w");
+    if (!file)
+        return false;
+    // one benchmark per line, which is also what readResults expects
+    fprintf(file, "{\n  \"unit\": \"ns\",\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &result = results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"samples\": %d, \"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f, \"min\": %.3f}%s\n",
+                result.name.c_str(), result.samples, result.median, result.mean, result.stddev, result.min,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+// Read a file written by writeResults
+static bool readResults(const string &fileName, vector<Result> &results)
+{
+    FILE *file = fopen(fileName.c_str(), "r");
+    if (!file)
+        return false;
+    char line[1024];
+    while (fgets(line, sizeof(line), file))
+    {
+        auto number = [&](const char *key, double &value)
+        {
+            const char *found = strstr(line, key);
+            if (found)
+                value = atof(found + strlen(key));
+        };
+        const char *name = strstr(line, "\"name\": \"");
+        if (!name)
+            continue;
+        name += strlen("\"name\": \"");
+        Result result;
+        result.name.assign(name, strcspn(name, "\""));
+        double samples = 0;
+        number("\"samples\": ", samples);
+        result.samples = (int)samples;
+        number("\"median\": ", result.median);
+        number("\"mean\": ", result.mean);
+        number("\"stddev\": ", result.stddev);
+        number("\"min\": ", result.min);
+        results.push_back(result);
+    }
+    fclose(file);
+    return true;
+}
+
+// Compare with the baseline, returns the number of regressions
+static int compare(const vector<Result> &baseline, const vector<Result> &results, double threshold)
+{
+    int regressions = 0;
+    printf("\n%-32s %12s %12s %8s %7s\n", "benchmark", "baseline ns", "now ns", "change", "t");
+    for (const Result &result : results)
+    {
+        auto old = find_if(baseline.begin(), baseline.end(), [&](const Result &r) { return r.name == result.name; });
+        if (old == baseline.end())
+        {
+            printf("%-32s %12s %12.1f %8s %7s  new\n", result.name.c_str(), "-", result.median, "", "");
+            continue;
+        }
+        // The change is measured on the medians, which a few preempted
+        // samples do not move, and only counts if Welch's t on the means
+        // also says it is well outside the noise of the two runs
+        double change = (result.median / old->median - 1) * 100;
+        double error = sqrt(result.stddev * result.stddev / max(1, result.samples) +
+                            old->stddev * old->stddev / max(1, old->samples));
+        double t = error > 0 ? (result.mean - old->mean) / error : 0;
+        const char *verdict = "";
+        if (change > threshold && t > 3)
+        {
+            verdict = "REGRESSION";
+            regressions++;
+        }
+        else if (change < -threshold && t < -3)
+        {
+            verdict = "faster";
+        }
+        printf("%-32s %12.1f %12.1f %+7.1f%% %7.1f  %s\n", result.name.c_str(), old->median, result.median,
+               change, t, verdict);
+    }
+    return regressions;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+
+    vector<Result> baseline;
+    if (!options.baselineFile.empty() && !readResults(options.baselineFile, baseline))
+        printf("no baseline in %s, nothing to compare with\n", options.baselineFile.c_str());
+
+    Bench bench(options);
+    rayBenchmarks(bench);
+    mazeBenchmarks(bench);
+    miniMapBenchmarks(bench);
+    flushBenchmarks(bench);
+
+    if (!writeResults(options.outputFile, bench.results()))
+    {
+        fprintf(stderr, "could not write %s\n", options.outputFile.c_str());
+        return 1;
+    }
+    printf("results written to %s\n", options.outputFile.c_str());
+
+    if (baseline.empty())
+        return 0;
+    int regressions = compare(baseline, bench.results(), options.threshold);
+    printf("%d regression(s) over %.0f%%\n", regressions, options.threshold);
+    return options.strict && regressions > 0 ? 1 : 0;
+}
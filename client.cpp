@@ -0,0 +1,331 @@
+// Client of fps_server. Plays in the shared world in this terminal, or
+// with --bots simulates headless players to find out how many clients
+// the server can keep at its frame rate.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+#include "AnsiOutput.h"
+#include "EntityLayer.h"
+#include "Random.h"
+#include "RenderProtocol.h"
+
+using namespace std;
+
+struct Options
+{
+    string socketPath = "/tmp/fps.sock";
+    int width = 0;              // frame size, 0 fits the terminal (80 x 40 for bots)
+    int height = 0;
+    int bots = 0;               // headless players, 0 plays in the terminal
+    int ramp = 0;               // bots added after each round while they keep up
+    float seconds = 5;          // length of a measuring round
+    float targetFps = 30;       // frame rate the bots count as keeping up
+};
+
+static void usage()
+{
+    printf("usage: fps_client [options]\n"
+           "  --socket PATH      server socket (default /tmp/fps.sock)\n"
+           "  --size W H         frame size in characters (default the terminal, 80 40 for bots)\n"
+           "  --bots N           simulate N headless players instead of playing\n"
+           "  --ramp N           add N bots after every round in which they kept up\n"
+           "  --seconds S        length of a measuring round (default 5)\n"
+           "  --fps N            frame rate the bots have to get to keep up (default 30)\n");
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--socket" && hasValue)              options.socketPath = argv[++i];
+        else if (arg == "--bots" && hasValue)           options.bots = atoi(argv[++i]);
+        else if (arg == "--ramp" && hasValue)           options.ramp = atoi(argv[++i]);
+        else if (arg == "--seconds" && hasValue)        options.seconds = atof(argv[++i]);
+        else if (arg == "--fps" && hasValue)            options.targetFps = atof(argv[++i]);
+        else if (arg == "--size" && i + 2 < argc)
+        {
+            options.width = atoi(argv[++i]);
+            options.height = atoi(argv[++i]);
+        }
+        else
+        {
+            usage();
+            return false;
+        }
+    }
+    return true;
+}
+
+static void sendHello(Connection &connection, int width, int height)
+{
+    HelloMessage hello = { width, height };
+    connection.send(MessageType::Hello, &hello, sizeof(hello));
+}
+
+static void sendKey(Connection &connection, int key)
+{
+    KeyMessage message = { key };
+    connection.send(MessageType::Key, &message, sizeof(message));
+}
+
+static void sendAck(Connection &connection, uint32_t frame)
+{
+    AckMessage ack = { frame };
+    connection.send(MessageType::Ack, &ack, sizeof(ack));
+}
+
+// Play in this terminal: keys go to the server, frames come back
+static int play(const Options &options)
+{
+    Connection connection(Connection::connectTo(options.socketPath));
+    if (!connection.isOpen())
+    {
+        fprintf(stderr, "could not connect to %s\n", options.socketPath.c_str());
+        return 1;
+    }
+
+    winsize size = {};
+    ioctl(STDOUT_FILENO, TIOCGWINSZ, &size);
+    int columns = size.ws_col > 0 ? size.ws_col : 80;
+    int rows = size.ws_row > 0 ? size.ws_row : 24;
+    int width = options.width > 0 ? options.width : columns;
+    int height = options.height > 0 ? options.height : rows - 1;     // the last row is the status line
+    sendHello(connection, width, height);
+
+    // keys one at a time without echo, and the screen to ourselves
+    termios saved, raw;
+    tcgetattr(STDIN_FILENO, &saved);
+    raw = saved;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    printf("\x1b[?1049h\x1b[2J\x1b[?25l");
+    fflush(stdout);
+
+    AnsiOutput output;
+    output.resize(columns, rows);
+    const short colorPairs[][3] =
+    {
+        { 1, 0, 7 },
+        { 2, 0, 3 },
+        { 3, 0, 4 },
+        { 4, 7, 0 },
+        { EntityLayer::EntityColor, 3, 0 },
+    };
+    for (const auto &pair : colorPairs)
+        output.definePair(pair[0], pair[1], pair[2]);
+
+    FrameBuffer frame;
+    bool running = true;
+    const char *exitReason = nullptr;
+    long frames = 0, bytes = 0;
+    auto start = chrono::steady_clock::now();
+    MessageType type;
+    string payload;
+    while (running)
+    {
+        pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 },
+                          { connection.fd(), (short)(POLLIN | (connection.hasOutput() ? POLLOUT : 0)), 0 } };
+        if (poll(fds, 2, 100) < 0)
+            continue;
+
+        char keys[64];
+        ssize_t count = (fds[0].revents & POLLIN) ? read(STDIN_FILENO, keys, sizeof(keys)) : 0;
+        for (ssize_t i = 0; i < count; i++)
+        {
+            if (keys[i] == 'q' || keys[i] == 'Q')
+                running = false;
+            else
+                sendKey(connection, keys[i]);
+        }
+
+        if ((fds[1].revents & (POLLIN | POLLHUP | POLLERR)) && !connection.receive())
+        {
+            exitReason = "the server closed the connection";
+            running = false;
+        }
+        while (connection.nextMessage(type, payload))
+        {
+            uint32_t number;
+            if (type != MessageType::Frame || !Connection::decodeFrame(payload, frame, number))
+            {
+                exitReason = "bad message from the server";
+                running = false;
+                break;
+            }
+            frames++;
+            bytes += payload.size();
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            char status[128];
+            snprintf(status, sizeof(status), "frame %-8u %5.1f fps  %7.1f kB/s  q quits", number,
+                     frames / seconds, bytes / seconds / 1024);
+
+            output.beginFrame();
+            // the server sends the border too, draw the box over it like the game does
+            if (!frame.presentedValid())
+                output.drawBox(0, 0, frame.width(), frame.height());
+            output.presentFrame(frame, 0, 0, true);
+            output.drawText(0, frame.height(), status);
+            output.endFrame();
+            sendAck(connection, number);
+        }
+        connection.flush();
+    }
+
+    printf("\x1b[?25h\x1b[?1049l");
+    fflush(stdout);
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    if (exitReason)
+        fprintf(stderr, "%s\n", exitReason);
+    return exitReason ? 1 : 0;
+}
+
+// One simulated player: walks forwards while always turning one way or
+// the other, so its view changes on every tick even against a wall, and
+// acknowledges every frame as soon as it is decoded
+struct Bot
+{
+    explicit Bot(int fd, uint64_t seed) : connection(fd), random(seed) {}
+
+    Connection connection;
+    FrameBuffer frame;
+    Random random;
+    int turnKey = 'a';
+    chrono::steady_clock::time_point nextKey;
+    chrono::steady_clock::time_point nextTurn;
+    long frames = 0;
+    long bytes = 0;
+};
+
+// Run the bots for the given time, answering frames and sending keys
+static bool driveBots(vector<unique_ptr<Bot>> &bots, float seconds)
+{
+    using Clock = chrono::steady_clock;
+    auto end = Clock::now() + chrono::duration_cast<Clock::duration>(chrono::duration<float>(seconds));
+    vector<pollfd> fds(bots.size());
+    MessageType type;
+    string payload;
+    for (auto now = Clock::now(); now < end; now = Clock::now())
+    {
+        for (size_t i = 0; i < bots.size(); i++)
+        {
+            Bot &bot = *bots[i];
+            // a key every 50 ms keeps the action held on the server
+            if (now >= bot.nextKey)
+            {
+                if (now >= bot.nextTurn)
+                {
+                    bot.turnKey = bot.random.coin() ? 'a' : 'd';
+                    bot.nextTurn = now + chrono::milliseconds(200 + bot.random.below(1000));
+                }
+                sendKey(bot.connection, 'w');
+                sendKey(bot.connection, bot.turnKey);
+                bot.nextKey = now + chrono::milliseconds(50);
+            }
+            if (!bot.connection.flush())
+                return false;
+            fds[i] = { bot.connection.fd(), (short)(POLLIN | (bot.connection.hasOutput() ? POLLOUT : 0)), 0 };
+        }
+        if (poll(fds.data(), fds.size(), 10) < 0)
+            continue;
+
+        for (size_t i = 0; i < bots.size(); i++)
+        {
+            Bot &bot = *bots[i];
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            if (!bot.connection.receive())
+                return false;
+            while (bot.connection.nextMessage(type, payload))
+            {
+                uint32_t number;
+                if (type != MessageType::Frame || !Connection::decodeFrame(payload, bot.frame, number))
+                    return false;
+                bot.frames++;
+                bot.bytes += payload.size();
+                sendAck(bot.connection, number);
+            }
+        }
+    }
+    return true;
+}
+
+// Connect the bots in rounds and report the frame rate each one got. With
+// a ramp, more bots join after every round until they stop keeping up.
+static int loadTest(const Options &options)
+{
+    int width = options.width > 0 ? options.width : 80;
+    int height = options.height > 0 ? options.height : 40;
+    vector<unique_ptr<Bot>> bots;
+    int served = 0;         // most bots that all kept up
+    for (int target = options.bots; ; target += options.ramp)
+    {
+        while ((int)bots.size() < target)
+        {
+            int fd = Connection::connectTo(options.socketPath);
+            if (fd < 0)
+            {
+                fprintf(stderr, "could not connect to %s\n", options.socketPath.c_str());
+                return 1;
+            }
+            bots.emplace_back(new Bot(fd, bots.size() + 1));
+            sendHello(bots.back()->connection, width, height);
+        }
+
+        // let the new bots settle in before measuring
+        if (!driveBots(bots, 1.0f))
+        {
+            fprintf(stderr, "the server closed a connection\n");
+            return 1;
+        }
+        for (auto &bot : bots)
+            bot->frames = bot->bytes = 0;
+        if (!driveBots(bots, options.seconds))
+        {
+            fprintf(stderr, "the server closed a connection\n");
+            return 1;
+        }
+
+        vector<double> fps;
+        long bytes = 0;
+        for (auto &bot : bots)
+        {
+            fps.push_back(bot->frames / options.seconds);
+            bytes += bot->bytes;
+        }
+        sort(fps.begin(), fps.end());
+        double median = fps[fps.size() / 2];
+        printf("bots %4zu  fps per bot: min %5.1f  median %5.1f  max %5.1f  total %7.1f kB/s\n",
+               bots.size(), fps.front(), median, fps.back(), bytes / options.seconds / 1024);
+        fflush(stdout);
+
+        // keeping up allows for the odd tick lost to scheduling
+        bool keptUp = fps.front() >= options.targetFps * 0.9;
+        if (keptUp)
+            served = bots.size();
+        if (options.ramp <= 0 || !keptUp)
+            break;
+    }
+    printf("%d bots kept up with %.0f fps\n", served, options.targetFps);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+    return options.bots > 0 ? loadTest(options) : play(options);
+}
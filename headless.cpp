@@ -0,0 +1,540 @@
+// Headless renderer: replays a scripted camera path through the same
+// raycaster and shading as the game, without a terminal, and reports
+// frame timings. Used to benchmark on machines without a TTY.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+
+#include "DistanceField.h"
+#include "EntityLayer.h"
+#include "FlowField.h"
+#include "FrameBuffer.h"
+#include "Lightmap.h"
+#include "MazeGenerator.h"
+#include "QualityGovernor.h"
+#include "Random.h"
+#include "Renderer.h"
+#include "Swarm.h"
+
+#define PI 3.14159265f
+
+using namespace std;
+
+struct Options
+{
+    string pathFile;
+    string mapFile;
+    string checksumFile;
+    string saveFile;
+    int mazeWidth = 10;
+    int mazeHeight = 10;
+    int pathWidth = 2;
+    unsigned seed = 1;
+    MazeGenerator::Algorithm generator = MazeGenerator::Backtracker;
+    int screenWidth = 80;
+    int screenHeight = 40;
+    float depth = 0;            // 0 means the map height, like the game
+    int frames = 360;           // length of the default path
+    int threads = 1;            // 0 uses every core
+    Raycaster::Mode mode = Raycaster::Mode::DDA;
+    Raycaster::Kernel kernel = Raycaster::bestKernel();
+    bool verifySimd = false;
+    bool columnCache = false;
+    int entities = 0;
+    int agents = 0;
+    int lights = 0;
+    bool textures = false;
+    float budget = 0;           // render budget in ms for the quality governor, 0 for none
+    int openWidth = 0;          // an open room instead of a maze, like the editor's clear
+    int openHeight = 0;
+};
+
+static void usage()
+{
+    printf("usage: fps_headless [options]\n"
+           "  --path FILE        camera path, one \"x y angle fov\" line per frame (degrees)\n"
+           "  --map FILE         map file, or text map ('#' is a wall), instead of a maze\n"
+           "  --save FILE        save the map to FILE in the map file format\n"
+           "  --maze W H         maze size in cells (default 10 10)\n"
+           "  --open W H         an empty W x H room with walls only around it, instead of a maze\n"
+           "  --seed N           maze seed (default 1)\n"
+           "  --generator G      maze generator: backtracker or eller (default backtracker)\n"
+           "  --size W H         frame size in characters (default 80 40)\n"
+           "  --depth D          maximum ray depth (default map height)\n"
+           "  --frames N         frames of the default path, a turn on the spot (default 360)\n"
+           "  --mode M           raycaster mode: dda, field or legacy (default dda)\n"
+           "  --kernel K         packet kernel: scalar, sse, avx2 or auto (default auto)\n"
+           "  --threads N        render threads, 0 uses every core (default 1)\n"
+           "  --cache            keep column hits between frames (snaps the angle to columns)\n"
+           "  --entities N       scatter N billboard entities over the map\n"
+           "  --agents N         N agents chasing the camera, one 60 Hz tick after every frame\n"
+           "  --lights N         bake N point lights scattered over the floor and shade with them\n"
+           "  --textures         textured walls, a random texture for each 8x8 block of cells\n"
+           "  --budget MS        lower the quality to render each frame within MS milliseconds\n"
+           "  --checksums FILE   write a checksum of every frame to FILE\n"
+           "  --verify-simd      compare the SIMD kernels with the scalar one on random maps\n");
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        auto needs = [&](int count)
+        {
+            if (i + count >= argc)
+            {
+                fprintf(stderr, "%s needs %d argument(s)\n", arg.c_str(), count);
+                return false;
+            }
+            return true;
+        };
+
+        if (arg == "--path" && needs(1))                options.pathFile = argv[++i];
+        else if (arg == "--map" && needs(1))            options.mapFile = argv[++i];
+        else if (arg == "--checksums" && needs(1))      options.checksumFile = argv[++i];
+        else if (arg == "--save" && needs(1))           options.saveFile = argv[++i];
+        else if (arg == "--seed" && needs(1))           options.seed = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--depth" && needs(1))          options.depth = atof(argv[++i]);
+        else if (arg == "--frames" && needs(1))         options.frames = atoi(argv[++i]);
+        else if (arg == "--threads" && needs(1))        options.threads = atoi(argv[++i]);
+        else if (arg == "--verify-simd")                options.verifySimd = true;
+        else if (arg == "--cache")                      options.columnCache = true;
+        else if (arg == "--entities" && needs(1))       options.entities = atoi(argv[++i]);
+        else if (arg == "--agents" && needs(1))         options.agents = atoi(argv[++i]);
+        else if (arg == "--lights" && needs(1))         options.lights = atoi(argv[++i]);
+        else if (arg == "--textures")                   options.textures = true;
+        else if (arg == "--budget" && needs(1))         options.budget = atof(argv[++i]);
+        else if (arg == "--maze" && needs(2))
+        {
+            options.mazeWidth = atoi(argv[++i]);
+            options.mazeHeight = atoi(argv[++i]);
+        }
+        else if (arg == "--open" && needs(2))
+        {
+            options.openWidth = atoi(argv[++i]);
+            options.openHeight = atoi(argv[++i]);
+        }
+        else if (arg == "--size" && needs(2))
+        {
+            options.screenWidth = atoi(argv[++i]);
+            options.screenHeight = atoi(argv[++i]);
+        }
+        else if (arg == "--mode" && needs(1))
+        {
+            string mode = argv[++i];
+            if (mode == "dda")              options.mode = Raycaster::Mode::DDA;
+            else if (mode == "field")       options.mode = Raycaster::Mode::Field;
+            else if (mode == "legacy")      options.mode = Raycaster::Mode::Legacy;
+            else
+            {
+                fprintf(stderr, "unknown mode %s\n", mode.c_str());
+                return false;
+            }
+        }
+        else if (arg == "--generator" && needs(1))
+        {
+            string generator = argv[++i];
+            if (generator == "backtracker") options.generator = MazeGenerator::Backtracker;
+            else if (generator == "eller")  options.generator = MazeGenerator::Eller;
+            else
+            {
+                fprintf(stderr, "unknown generator %s\n", generator.c_str());
+                return false;
+            }
+        }
+        else if (arg == "--kernel" && needs(1))
+        {
+            string kernel = argv[++i];
+            if (kernel == "scalar")         options.kernel = Raycaster::Kernel::Scalar;
+            else if (kernel == "sse")       options.kernel = Raycaster::Kernel::SSE;
+            else if (kernel == "avx2")      options.kernel = Raycaster::Kernel::AVX2;
+            else if (kernel == "auto")      options.kernel = Raycaster::bestKernel();
+            else
+            {
+                fprintf(stderr, "unknown kernel %s\n", kernel.c_str());
+                return false;
+            }
+        }
+        else
+        {
+            usage();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Trace the same rays and frames with every SIMD kernel the CPU supports
+// and with the scalar kernel on random maps. Hits must agree on cell and
+// face, distances and texture coordinates to within a relative 1e-5, and
+// the shaded frames must be identical.
+static bool verifySimd(unsigned seed)
+{
+    const float tolerance = 1e-5f;
+    mt19937 random(seed);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    long rays = 0, frames = 0, failures = 0;
+
+    for (Raycaster::Kernel kernel : { Raycaster::Kernel::SSE, Raycaster::Kernel::AVX2 })
+    {
+        if (!Raycaster::kernelSupported(kernel))
+        {
+            printf("%-6s not supported by this CPU, skipped\n", Raycaster::kernelName(kernel));
+            continue;
+        }
+
+        Raycaster scalar, simd;
+        scalar.setKernel(Raycaster::Kernel::Scalar);
+        simd.setKernel(kernel);
+        Renderer scalarRenderer, simdRenderer;
+        scalarRenderer.raycaster().setKernel(Raycaster::Kernel::Scalar);
+        simdRenderer.raycaster().setKernel(kernel);
+        FrameBuffer scalarFrame, simdFrame;
+        scalarFrame.resize(97, 41);
+        simdFrame.resize(97, 41);
+
+        for (int test = 0; test < 200; test++)
+        {
+            // random walls of random density, sometimes open, sometimes solid
+            int mapWidth = 4 + random() % 60;
+            int mapHeight = 4 + random() % 60;
+            float density = unit(random) * 0.5f;
+            WallMap map(mapWidth, mapHeight);
+            for (int y = 0; y < mapHeight; y++)
+                for (int x = 0; x < mapWidth; x++)
+                    map.setWall(x, y, unit(random) < density);
+            float originX = 0.01f + unit(random) * (mapWidth - 0.02f);
+            float originY = 0.01f + unit(random) * (mapHeight - 0.02f);
+            if (test % 5 == 1)
+            {
+                // on a cell corner, like the player after the editor's 3,
+                // so walls next to it are hit at distance 0
+                originX = 1 + random() % (mapWidth - 1);
+                originY = 1 + random() % (mapHeight - 1);
+            }
+            float depth = 1.0f + unit(random) * max(mapWidth, mapHeight);
+
+            float eyeX[Raycaster::MaxPacket], eyeY[Raycaster::MaxPacket];
+            RayHit expected[Raycaster::MaxPacket], actual[Raycaster::MaxPacket];
+            int count = 1 + random() % Raycaster::MaxPacket;
+            float angle = unit(random) * 2.0f * PI;
+            for (int i = 0; i < count; i++)
+            {
+                // mostly neighbouring columns, with some axis aligned rays
+                float rayAngle = test % 10 == 0 ? (random() % 4) * PI / 2.0f : angle + i * 0.01f;
+                eyeX[i] = sin(rayAngle);
+                eyeY[i] = cos(rayAngle);
+                expected[i] = scalar.cast(map, originX, originY, eyeX[i], eyeY[i], depth);
+            }
+            simd.castPacket(map, originX, originY, eyeX, eyeY, count, depth, actual);
+            for (int i = 0; i < count; i++, rays++)
+            {
+                const RayHit &a = expected[i], &b = actual[i];
+                float scale = max(1.0f, fabs(a.distance));
+                if (a.hit != b.hit || a.cellX != b.cellX || a.cellY != b.cellY || a.face != b.face
+                    || fabs(a.distance - b.distance) > tolerance * scale || fabs(a.wallX - b.wallX) > tolerance
+                    || (a.hit && a.distance < Raycaster::MinHitDistance))
+                {
+                    if (failures++ < 10)
+                        printf("%s ray mismatch: map %dx%d origin %f,%f eye %f,%f distance %f vs %f\n",
+                               Raycaster::kernelName(kernel), mapWidth, mapHeight, originX, originY,
+                               eyeX[i], eyeY[i], a.distance, b.distance);
+                }
+            }
+
+            Camera camera;
+            camera.x = originX;
+            camera.y = originY;
+            camera.angle = angle;
+            scalarRenderer.render(camera, map, depth, scalarFrame);
+            simdRenderer.render(camera, map, depth, simdFrame);
+            frames++;
+            if (scalarFrame.checksum() != simdFrame.checksum() && failures++ < 10)
+                printf("%s frame mismatch: map %dx%d camera %f,%f,%f\n",
+                       Raycaster::kernelName(kernel), mapWidth, mapHeight, camera.x, camera.y, camera.angle);
+        }
+        printf("%-6s checked against SCALAR\n", Raycaster::kernelName(kernel));
+    }
+
+    printf("rays: %ld, frames: %ld, mismatches: %ld\n", rays, frames, failures);
+    return failures == 0;
+}
+
+// Text map: one line per row, '#' is a wall and anything else is floor.
+// Short lines are padded with floor.
+static bool loadTextMap(const string &fileName, WallMap &map)
+{
+    ifstream file(fileName);
+    if (!file)
+        return false;
+
+    vector<string> rows;
+    string line;
+    int mapWidth = 0;
+    while (getline(file, line))
+    {
+        rows.push_back(line);
+        mapWidth = max(mapWidth, (int)line.size());
+    }
+    int mapHeight = rows.size();
+    map.resize(mapWidth, mapHeight);
+    for (int y = 0; y < mapHeight; y++)
+        for (int x = 0; x < (int)rows[y].size(); x++)
+            map.setWall(x, y, rows[y][x] == '#');
+    return mapWidth > 0 && mapHeight > 0;
+}
+
+static bool loadPath(const string &fileName, vector<Camera> &path)
+{
+    ifstream file(fileName);
+    if (!file)
+        return false;
+
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        istringstream fields(line);
+        Camera camera;
+        float angle, fov;
+        if (!(fields >> camera.x >> camera.y >> angle >> fov))
+        {
+            fprintf(stderr, "bad camera path line: %s\n", line.c_str());
+            return false;
+        }
+        camera.angle = angle * PI / 180.0f;
+        camera.fov = fov * PI / 180.0f;
+        path.push_back(camera);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+    if (options.verifySimd)
+        return verifySimd(options.seed) ? 0 : 1;
+
+    WallMap map;
+    PlayerStart playerStart;
+    double generateSeconds = -1;
+    if (!options.mapFile.empty())
+    {
+        if (!map.load(options.mapFile, playerStart) && !loadTextMap(options.mapFile, map))
+        {
+            fprintf(stderr, "could not load map %s\n", options.mapFile.c_str());
+            return 1;
+        }
+    }
+    else if (options.openWidth > 0 && options.openHeight > 0)
+    {
+        map.resize(options.openWidth, options.openHeight);
+        map.fillRow(0, 0, options.openWidth, true);
+        map.fillRow(options.openHeight - 1, 0, options.openWidth, true);
+        for (int y = 0; y < options.openHeight; y++)
+        {
+            map.setWall(0, y, true);
+            map.setWall(options.openWidth - 1, y, true);
+        }
+    }
+    else
+    {
+        auto generateStart = chrono::steady_clock::now();
+        MazeGenerator generator;
+        generator.generate(map, options.mazeWidth, options.mazeHeight, options.pathWidth, options.seed,
+                           options.generator);
+        generateSeconds = chrono::duration<double>(chrono::steady_clock::now() - generateStart).count();
+    }
+    float depth = options.depth > 0 ? options.depth : map.height();
+    if (!options.saveFile.empty() && !map.save(options.saveFile, playerStart))
+    {
+        fprintf(stderr, "could not save map %s\n", options.saveFile.c_str());
+        return 1;
+    }
+
+    vector<Camera> path;
+    if (!options.pathFile.empty())
+    {
+        if (!loadPath(options.pathFile, path))
+        {
+            fprintf(stderr, "could not load camera path %s\n", options.pathFile.c_str());
+            return 1;
+        }
+    }
+    else
+    {
+        // turn once on the spot at the start cell
+        for (int i = 0; i < options.frames; i++)
+        {
+            Camera camera;
+            camera.x = 1.5f;
+            camera.y = 1.5f;
+            camera.angle = 2.0f * PI * i / options.frames;
+            path.push_back(camera);
+        }
+    }
+    if (path.empty())
+    {
+        fprintf(stderr, "camera path is empty\n");
+        return 1;
+    }
+
+    FILE *checksums = nullptr;
+    if (!options.checksumFile.empty())
+    {
+        checksums = fopen(options.checksumFile.c_str(), "w");
+        if (!checksums)
+        {
+            fprintf(stderr, "could not open %s\n", options.checksumFile.c_str());
+            return 1;
+        }
+    }
+
+    ThreadPool threadPool(options.threads);
+    Renderer renderer;
+    renderer.setThreadPool(&threadPool);
+    renderer.raycaster().setMode(options.mode);
+    renderer.raycaster().setKernel(options.kernel);
+    DistanceField field;
+    double fieldSeconds = -1;
+    if (options.mode == Raycaster::Mode::Field)
+    {
+        auto fieldStart = chrono::steady_clock::now();
+        field.build(map);
+        fieldSeconds = chrono::duration<double>(chrono::steady_clock::now() - fieldStart).count();
+        renderer.raycaster().setDistanceField(&field);
+    }
+    renderer.setColumnCache(options.columnCache);
+    // lights on random floor cells, baked with the render threads
+    Lightmap lightmap;
+    vector<Light> lights;
+    Random lightRandom(options.seed + 2);
+    for (long attempts = (long)options.lights * 64; (int)lights.size() < options.lights && attempts > 0; attempts--)
+    {
+        Light light;
+        light.x = lightRandom.below(map.width());
+        light.y = lightRandom.below(map.height());
+        if (!map.isWall(light.x, light.y))
+            lights.push_back(light);
+    }
+    lightmap.setLights(lights);
+    if (!lightmap.empty())
+        lightmap.bake(map, &threadPool);
+    renderer.setLightmap(&lightmap);
+    TextureAtlas atlas;
+    TextureMap textures;
+    textures.resize(map.width(), map.height());
+    Random textureRandom(options.seed + 3);
+    for (int y = 0; y < map.height(); y += 8)
+        for (int x = 0; x < map.width(); x += 8)
+            textures.fill(x, y, x + 8, y + 8, textureRandom.below(TextureAtlas::TextureCount));
+    if (options.textures)
+        renderer.setTextures(&atlas, &textures);
+    EntityLayer entities;
+    entities.scatter(map, options.entities, options.seed);
+    renderer.setEntities(&entities);
+    FlowField flowField;
+    Swarm swarm;
+    swarm.spawn(entities, map, options.agents, options.seed + 1);
+    vector<double> tickTimes;
+    int searches = 0;
+    QualityGovernor governor;
+    governor.setBudget(options.budget / 1000.0);
+    vector<int> framesAtLevel(QualityGovernor::levelCount());
+    FrameBuffer frame;
+    frame.resize(options.screenWidth, options.screenHeight);
+
+    vector<double> frameTimes;
+    frameTimes.reserve(path.size());
+    long totalRaySteps = 0;
+    long totalWallHits = 0;
+    long totalColumns = 0;
+    long totalConsidered = 0;
+    long totalDrawn = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        auto frameStart = chrono::steady_clock::now();
+        renderer.setColumnStep(governor.columnStep());
+        framesAtLevel[governor.level()]++;
+        renderer.render(path[i], map, depth * governor.depthScale(), frame);
+        chrono::duration<double, milli> frameTime = chrono::steady_clock::now() - frameStart;
+        frameTimes.push_back(frameTime.count());
+        governor.update(frameTime.count() / 1000.0);
+
+        totalRaySteps += renderer.stats().raySteps;
+        totalWallHits += renderer.stats().wallHits;
+        totalColumns += renderer.stats().columnsTraced;
+        totalConsidered += renderer.stats().entitiesConsidered;
+        totalDrawn += renderer.stats().entitiesDrawn;
+        if (checksums)
+            fprintf(checksums, "%zu %016llx\n", i, frame.checksum());
+
+        if (!swarm.empty())
+        {
+            auto tickStart = chrono::steady_clock::now();
+            searches += flowField.update(map, (int)path[i].x, (int)path[i].y);
+            swarm.update(entities, flowField, map, 1.0f / 60.0f, &threadPool);
+            chrono::duration<double, milli> tickTime = chrono::steady_clock::now() - tickStart;
+            tickTimes.push_back(tickTime.count());
+        }
+    }
+    chrono::duration<double> totalTime = chrono::steady_clock::now() - start;
+    if (checksums)
+        fclose(checksums);
+
+    sort(frameTimes.begin(), frameTimes.end());
+    sort(tickTimes.begin(), tickTimes.end());
+    auto percentile = [&](double p) { return frameTimes[(size_t)(p * (frameTimes.size() - 1))]; };
+
+    printf("map:            %d x %d (%zu bytes%s)\n", map.width(), map.height(), map.memoryBytes(),
+           map.isMapped() ? ", mapped" : "");
+    if (generateSeconds >= 0)
+        printf("maze:           %d x %d, %s, %.3f s\n", options.mazeWidth, options.mazeHeight,
+               MazeGenerator::algorithmName(options.generator), generateSeconds);
+    if (fieldSeconds >= 0)
+        printf("distance field: %zu bytes, %.3f s\n", field.memoryBytes(), fieldSeconds);
+    printf("frame size:     %d x %d\n", options.screenWidth, options.screenHeight);
+    printf("raycaster:      %s (%s)\n", Raycaster::modeName(options.mode),
+           Raycaster::kernelName(renderer.raycaster().kernel()));
+    printf("threads:        %d\n", threadPool.threadCount());
+    printf("frames:         %zu\n", path.size());
+    printf("total time:     %.3f s\n", totalTime.count());
+    printf("frames/sec:     %.1f\n", path.size() / totalTime.count());
+    printf("frame time p50: %.3f ms\n", percentile(0.50));
+    printf("frame time p99: %.3f ms\n", percentile(0.99));
+    printf("ray steps:      %ld\n", totalRaySteps);
+    printf("wall hits:      %ld\n", totalWallHits);
+    printf("columns traced: %ld of %ld%s\n", totalColumns, (long)path.size() * options.screenWidth,
+           options.columnCache ? " (column cache)" : "");
+    if (options.budget > 0)
+    {
+        printf("governor:       %.2f ms budget, frames per level:", options.budget);
+        for (int frames : framesAtLevel)
+            printf(" %d", frames);
+        printf(", ended at 1/%d columns, %d%% depth\n", governor.columnStep(),
+               (int)(governor.depthScale() * 100 + 0.5f));
+    }
+    if (!swarm.empty())
+        printf("agents:         %d, tick p50 %.3f ms, p99 %.3f ms, %d flow field searches\n", swarm.count(),
+               tickTimes[tickTimes.size() / 2], tickTimes[(size_t)(0.99 * (tickTimes.size() - 1))], searches);
+    if (!lightmap.empty())
+        printf("lights:         %zu, baked %d blocks in %.3f s\n", lightmap.lights().size(), lightmap.lastBakeBlocks(),
+               lightmap.lastBakeSeconds());
+    if (entities.count() > 0)
+        printf("entities:       %d, %.1f considered and %.1f drawn per frame\n", entities.count(),
+               (double)totalConsidered / path.size(), (double)totalDrawn / path.size());
+    return 0;
+}
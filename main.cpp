@@ -1,8 +1,76 @@
 #include "Game.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
-int main()
+int main(int argc, char **argv)
 {
-    Game game{};
+    GameOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            options.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+        {
+            options.targetFps = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc)
+        {
+            options.mapFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--maze") == 0 && i + 2 < argc)
+        {
+            options.mazeWidth = atoi(argv[++i]);
+            options.mazeHeight = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--eller") == 0)
+        {
+            options.generator = MazeGenerator::Eller;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc && strcmp(argv[i + 1], "ansi") == 0)
+        {
+            options.ansiOutput = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc && strcmp(argv[i + 1], "ncurses") == 0)
+        {
+            options.ansiOutput = false;
+            i++;
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            options.traceFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--entities") == 0 && i + 1 < argc)
+        {
+            options.entities = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--agents") == 0 && i + 1 < argc)
+        {
+            options.agents = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+        {
+            options.renderBudget = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-idle") == 0)
+        {
+            options.idle = false;
+        }
+        else
+        {
+            printf("usage: fps [--map FILE] [--seed N] [--maze W H] [--eller] [--threads N] [--fps N] [--output ncurses|ansi] [--trace FILE] [--entities N] [--agents N] [--budget MS] [--no-idle]\n");
+            return 1;
+        }
+    }
+
+    Game game{options};
     game.run();
 
     return 0;
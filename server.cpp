@@ -0,0 +1,116 @@
+// Render server: one shared world served over a Unix domain socket to
+// fps_client terminals and load generators, see RenderServer.
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "MazeGenerator.h"
+#include "RenderServer.h"
+
+using namespace std;
+
+struct Options
+{
+    string socketPath = "/tmp/fps.sock";
+    string mapFile;
+    int mazeWidth = 32;
+    int mazeHeight = 32;
+    unsigned seed = 1;
+    MazeGenerator::Algorithm generator = MazeGenerator::Backtracker;
+    int threads = 0;            // 0 uses every core
+    float tickRate = 30;
+    float depth = 0;            // 0 means the map height, like the game
+    float reportSeconds = 1;
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+static void usage()
+{
+    printf("usage: fps_server [options]\n"
+           "  --socket PATH      socket to listen on (default /tmp/fps.sock)\n"
+           "  --map FILE         map file to serve instead of a maze\n"
+           "  --maze W H         maze size in cells (default 32 32)\n"
+           "  --seed N           maze seed (default 1)\n"
+           "  --eller            generate the maze with Eller's algorithm\n"
+           "  --threads N        render threads, 0 uses every core (default 0)\n"
+           "  --fps N            ticks, and at most frames per client, per second (default 30)\n"
+           "  --depth D          maximum ray depth (default map height)\n"
+           "  --report S         print the load every S seconds, 0 for never (default 1)\n");
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--socket" && hasValue)              options.socketPath = argv[++i];
+        else if (arg == "--map" && hasValue)            options.mapFile = argv[++i];
+        else if (arg == "--seed" && hasValue)           options.seed = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--eller")                      options.generator = MazeGenerator::Eller;
+        else if (arg == "--threads" && hasValue)        options.threads = atoi(argv[++i]);
+        else if (arg == "--fps" && hasValue)            options.tickRate = atof(argv[++i]);
+        else if (arg == "--depth" && hasValue)          options.depth = atof(argv[++i]);
+        else if (arg == "--report" && hasValue)         options.reportSeconds = atof(argv[++i]);
+        else if (arg == "--maze" && i + 2 < argc)
+        {
+            options.mazeWidth = atoi(argv[++i]);
+            options.mazeHeight = atoi(argv[++i]);
+        }
+        else
+        {
+            usage();
+            return false;
+        }
+    }
+    if (options.tickRate <= 0)
+    {
+        usage();
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+
+    RenderServer server(options.threads);
+    PlayerStart start;
+    if (!options.mapFile.empty())
+    {
+        if (!server.map().load(options.mapFile, start))
+        {
+            fprintf(stderr, "could not load map %s\n", options.mapFile.c_str());
+            return 1;
+        }
+    }
+    else
+    {
+        MazeGenerator generator;
+        generator.generate(server.map(), options.mazeWidth, options.mazeHeight, 2, options.seed, options.generator);
+    }
+    server.setDepth(options.depth > 0 ? options.depth : server.map().height());
+
+    if (!server.listen(options.socketPath))
+    {
+        fprintf(stderr, "could not listen on %s\n", options.socketPath.c_str());
+        return 1;
+    }
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+    printf("serving a %dx%d map on %s at %.0f fps\n", server.map().width(), server.map().height(),
+           options.socketPath.c_str(), options.tickRate);
+    fflush(stdout);
+    server.run(options.tickRate, stopRequested, options.reportSeconds);
+    return 0;
+}